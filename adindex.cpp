@@ -0,0 +1,432 @@
+#include "adindex.hpp"
+#include "utils.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+using namespace camicasa;
+
+/// @brief magic number of the file, with its version
+static const char adIndexMagic[8] = {'S', 'I', 'C', 'A', 'D', 'I', 'D', 'X'};
+static const int adIndexVersion = 3;
+
+// the records are read in place from the mapped file, which fails on some ARM targets if their hashes are not aligned
+static_assert(sizeof(AdIndexHeader) % alignof(AdRecord) == 0, "ad records must be aligned after the header");
+static_assert(sizeof(AdRecord) % alignof(AdBandEntry) == 0, "ad tables must be aligned after the records");
+
+/// @brief number of tables of the file, one per 16 bits of the hashes
+static const int bandCount = 4;
+/// @brief maximum number of bits a hash may differ from the one of the ad
+static const int maximumHashDistance = 10;
+/// @brief minimum number of hashes of frames that are not uniform for a fingerprint to tell ads apart
+static const int minimumHashes = 2;
+
+/**
+    @brief Compare a fingerprint with the hashes of an ad
+    @param fingerprint hashes of the first seconds of a segment
+    @param hashes camicasa::FINGERPRINT_LENGTH hashes of the ad
+    @returns returns the sum of the bits the hashes differ in, -1 if they are not the same ad
+*/
+static int fingerprintDistance(const vector<uint64_t> &fingerprint, const uint64_t *hashes)
+{
+    int compared = 0;
+    int total = 0;
+
+    for (int i = 0; i < fingerprint.size() && i < FINGERPRINT_LENGTH; i++){
+        if (fingerprint[i] == UNIFORM_FRAME_HASH || hashes[i] == UNIFORM_FRAME_HASH)
+            continue;
+
+        int distance = hashDistance(fingerprint[i], hashes[i]);
+        if (distance > maximumHashDistance)
+            return -1;
+
+        total += distance;
+        compared++;
+    }
+
+    return (compared >= minimumHashes) ? total : -1;
+}
+
+/**
+    @brief Check whether the lookup of the tables can find an ad from a fingerprint: a hash of a frame that is not uniform
+    sharing the 16 bits of a table with the hash of the ad at the same position
+    @param fingerprint hashes of the first seconds of a segment
+    @param hashes camicasa::FINGERPRINT_LENGTH hashes of the ad
+    @returns returns true if the ad is a candidate of the tables
+*/
+static bool sharesBand(const vector<uint64_t> &fingerprint, const uint64_t *hashes)
+{
+    for (int i = 0; i < fingerprint.size() && i < FINGERPRINT_LENGTH; i++){
+        if (fingerprint[i] == UNIFORM_FRAME_HASH)
+            continue;
+
+        for (int band = 0; band < bandCount; band++)
+            if (((fingerprint[i] ^ hashes[i]) >> (16 * band) & 0xFFFF) == 0)
+                return true;
+    }
+
+    return false;
+}
+
+/// @returns returns true if the fingerprint has enough hashes of frames that are not uniform to tell ads apart
+static bool isInformative(const vector<uint64_t> &fingerprint)
+{
+    int hashes = 0;
+
+    for (int i = 0; i < fingerprint.size() && i < FINGERPRINT_LENGTH; i++)
+        if (fingerprint[i] != UNIFORM_FRAME_HASH)
+            hashes++;
+
+    return hashes >= minimumHashes;
+}
+
+/// @brief Order of the entries of the tables, by value and then by position in the fingerprint
+static bool compareBandEntries(const AdBandEntry &first, const AdBandEntry &second)
+{
+    if (first.value != second.value)
+        return first.value < second.value;
+
+    return first.position < second.position;
+}
+
+
+camicasa::AdIndex::AdIndex(string directory) {
+    this->directory = directory;
+    this->mapping = NULL;
+    this->mappingSize = 0;
+    this->nextId = 1;
+
+    mkdir(directory.c_str(), 0777);
+}
+
+camicasa::AdIndex::~AdIndex() {
+    this->close();
+}
+
+void camicasa::AdIndex::close() {
+    if (this->mapping != NULL)
+        munmap(this->mapping, this->mappingSize);
+
+    this->mapping = NULL;
+    this->mappingSize = 0;
+}
+
+bool camicasa::AdIndex::isValid() {
+    const AdIndexHeader *header = (const AdIndexHeader*)this->mapping;
+
+    bool valid = this->mappingSize >= sizeof(AdIndexHeader) && !memcmp(header->magic, adIndexMagic, sizeof(adIndexMagic)) &&
+                 header->version == adIndexVersion && header->count >= 0 && header->entries >= 0 &&
+                 sizeof(AdIndexHeader) + header->count * sizeof(AdRecord) + bandCount * (size_t)header->entries * sizeof(AdBandEntry) <= this->mappingSize;
+
+    const AdBandEntry *entries = (const AdBandEntry*)((const AdRecord*)(header + 1) + (valid ? header->count : 0));
+
+    for (int i = 0; valid && i < bandCount * header->entries; i++)
+        valid = entries[i].record >= 0 && entries[i].record < header->count && entries[i].position < FINGERPRINT_LENGTH;
+
+    if (!valid){
+        puts("Ad index is not valid, ignored");
+        this->close();
+    }
+
+    return valid;
+}
+
+bool camicasa::AdIndex::open() {
+    this->close();
+
+    string path = this->directory + "/ads.bin";
+
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0){
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (mapping != MAP_FAILED){
+            this->mapping = mapping;
+            this->mappingSize = info.st_size;
+        }
+    }
+
+    // the mapping stays valid without the descriptor
+    ::close(descriptor);
+
+    if (this->mapping == NULL || !this->isValid())
+        return false;
+
+    const AdIndexHeader *header = (const AdIndexHeader*)this->mapping;
+    const AdRecord *records = (const AdRecord*)(header + 1);
+
+    for (int i = 0; i < header->count; i++)
+        this->nextId = max(this->nextId, records[i].id + 1);
+
+    return true;
+}
+
+int camicasa::AdIndex::size() {
+    lock_guard<mutex> lock(this->pendingMutex);
+
+    int count = (this->mapping != NULL) ? ((const AdIndexHeader*)this->mapping)->count : 0;
+    return count + this->pending.size();
+}
+
+int camicasa::AdIndex::findMapped(const vector<uint64_t> &fingerprint, int &distance, int *duration) {
+    distance = -1;
+
+    if (this->mapping == NULL)
+        return -1;
+
+    const AdIndexHeader *header = (const AdIndexHeader*)this->mapping;
+    const AdRecord *records = (const AdRecord*)(header + 1);
+    const AdBandEntry *tables = (const AdBandEntry*)(records + header->count);
+
+    int found = -1;
+
+    for (int position = 0; position < fingerprint.size() && position < FINGERPRINT_LENGTH; position++){
+        if (fingerprint[position] == UNIFORM_FRAME_HASH)
+            continue;
+
+        for (int band = 0; band < bandCount; band++){
+            const AdBandEntry *table = tables + band * header->entries;
+
+            AdBandEntry key;
+            key.value = (fingerprint[position] >> (16 * band)) & 0xFFFF;
+            key.position = position;
+
+            const AdBandEntry *entry = lower_bound(table, table + header->entries, key, compareBandEntries);
+
+            // every entry with the same bits at the same position, so recent ads are not left out of a crowded bucket
+            for (; entry < table + header->entries && entry->value == key.value && entry->position == position; entry++){
+                int candidate = fingerprintDistance(fingerprint, records[entry->record].hashes);
+
+                if (candidate >= 0 && (distance < 0 || candidate < distance)){
+                    distance = candidate;
+                    found = entry->record;
+                }
+            }
+        }
+    }
+
+    if (found >= 0 && duration != NULL)
+        *duration = records[found].duration;
+
+    return (found >= 0) ? records[found].id : -1;
+}
+
+int camicasa::AdIndex::find(const vector<uint64_t> &fingerprint, int *duration) {
+    if (!isInformative(fingerprint))
+        return -1;
+
+    int distance;
+    int found = this->findMapped(fingerprint, distance, duration);
+
+    lock_guard<mutex> lock(this->pendingMutex);
+
+    // ads of this run are few, so they are compared one by one, as candidates only if the tables would find them once merged
+    for (int i = 0; i < this->pending.size(); i++){
+        if (!sharesBand(fingerprint, this->pending[i].hashes))
+            continue;
+
+        int candidate = fingerprintDistance(fingerprint, this->pending[i].hashes);
+
+        if (candidate >= 0 && (distance < 0 || candidate < distance)){
+            distance = candidate;
+            found = this->pending[i].id;
+
+            if (duration != NULL)
+                *duration = this->pending[i].duration;
+        }
+    }
+
+    return found;
+}
+
+int camicasa::AdIndex::add(const vector<uint64_t> &fingerprint, int duration) {
+    if (!isInformative(fingerprint))
+        return -1;
+
+    int distance;
+    int known = this->findMapped(fingerprint, distance);
+    if (known != -1)
+        return known;
+
+    lock_guard<mutex> lock(this->pendingMutex);
+
+    // checked while holding the lock, so an ad added by two copies of a channel at once is kept once
+    for (int i = 0; i < this->pending.size(); i++)
+        if (sharesBand(fingerprint, this->pending[i].hashes) && fingerprintDistance(fingerprint, this->pending[i].hashes) >= 0)
+            return this->pending[i].id;
+
+    AdRecord record;
+    memset(&record, 0, sizeof(record));
+    record.duration = duration;
+
+    for (int i = 0; i < fingerprint.size() && i < FINGERPRINT_LENGTH; i++)
+        record.hashes[i] = fingerprint[i];
+
+    record.id = this->nextId++;
+    this->pending.push_back(record);
+
+    return record.id;
+}
+
+int camicasa::AdIndex::merge(map<int, int> &identifiers) {
+    // runs merging at the same time take turns, each one reading the file left by the previous one
+    string lockPath = this->directory + "/ads.lock";
+    int lock = ::open(lockPath.c_str(), O_CREAT | O_RDWR, 0666);
+    if (lock >= 0)
+        flock(lock, LOCK_EX);
+
+    int added = this->mergeLocked(identifiers);
+
+    if (lock >= 0){
+        flock(lock, LOCK_UN);
+        ::close(lock);
+    }
+
+    return added;
+}
+
+int camicasa::AdIndex::mergeLocked(map<int, int> &identifiers) {
+    lock_guard<mutex> lock(this->pendingMutex);
+
+    identifiers.clear();
+
+    if (this->pending.empty())
+        return 0;
+
+    this->nextId = 1;
+    this->open();
+
+    // the records of the file, followed by the new ones
+    vector<AdRecord> records;
+
+    if (this->mapping != NULL){
+        const AdIndexHeader *header = (const AdIndexHeader*)this->mapping;
+        const AdRecord *mapped = (const AdRecord*)(header + 1);
+
+        records.assign(mapped, mapped + header->count);
+    }
+
+    int added = 0;
+
+    for (int i = 0; i < this->pending.size(); i++){
+        vector<uint64_t> fingerprint(this->pending[i].hashes, this->pending[i].hashes + FINGERPRINT_LENGTH);
+
+        // written by another run since the file was mapped
+        int distance;
+        int known = this->findMapped(fingerprint, distance);
+        if (known != -1){
+            identifiers[this->pending[i].id] = known;
+            continue;
+        }
+
+        AdRecord record = this->pending[i];
+        record.id = this->nextId++;
+        identifiers[this->pending[i].id] = record.id;
+
+        records.push_back(record);
+        added++;
+    }
+
+    if (added == 0){
+        this->pending.clear();
+        return 0;
+    }
+
+    // a table per 16 bits of the hashes, sorted by their value and position
+    vector<AdBandEntry> tables[bandCount];
+
+    for (int i = 0; i < records.size(); i++){
+        for (int position = 0; position < FINGERPRINT_LENGTH; position++){
+            if (records[i].hashes[position] == UNIFORM_FRAME_HASH)
+                continue;
+
+            for (int band = 0; band < bandCount; band++){
+                AdBandEntry entry;
+                entry.value = (records[i].hashes[position] >> (16 * band)) & 0xFFFF;
+                entry.position = position;
+                entry.record = i;
+
+                tables[band].push_back(entry);
+            }
+        }
+    }
+
+    for (int band = 0; band < bandCount; band++)
+        stable_sort(tables[band].begin(), tables[band].end(), compareBandEntries);
+
+    AdIndexHeader header;
+    memcpy(header.magic, adIndexMagic, sizeof(adIndexMagic));
+    header.version = adIndexVersion;
+    header.count = records.size();
+    header.entries = tables[0].size();
+    header.reserved = 0;
+
+    string path = this->directory + "/ads.bin";
+    string temporary = path + ".tmp";
+
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file.is_open()){
+        puts("Error writing ad index");
+        identifiers.clear();
+        return -1;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)records.data(), records.size() * sizeof(AdRecord));
+
+    for (int band = 0; band < bandCount; band++)
+        file.write((const char*)tables[band].data(), tables[band].size() * sizeof(AdBandEntry));
+
+    file.close();
+
+    if (file.fail() || rename(temporary.c_str(), path.c_str()) != 0){
+        puts("Error writing ad index");
+        identifiers.clear();
+        return -1;
+    }
+
+    this->pending.clear();
+    this->open();
+
+    return added;
+}
+
+uint64_t camicasa::hashFrame(const Mat &frame) {
+    // reused by each thread between frames
+    static thread_local Mat gray;
+    static thread_local Mat small;
+
+    convertToGray(frame, gray);
+    resize(gray, small, Size(9, 8), 0, 0, INTER_AREA);
+
+    Scalar mean, deviation;
+    meanStdDev(small, mean, deviation);
+
+    if (deviation(0) < 4)
+        return UNIFORM_FRAME_HASH;
+
+    uint64_t hash = 0;
+
+    for (int row = 0; row < 8; row++){
+        const uchar *pixels = small.ptr<uchar>(row);
+
+        for (int column = 0; column < 8; column++)
+            hash = (hash << 1) | (pixels[column] > pixels[column + 1]);
+    }
+
+    return hash;
+}
+
+int camicasa::hashDistance(uint64_t first, uint64_t second) {
+    return __builtin_popcountll(first ^ second);
+}
@@ -0,0 +1,150 @@
+#ifndef _ADINDEX_
+#define _ADINDEX_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <map>
+#include <cstdint>
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief number of frames hashed at the start of each segment, one per second from half a second in
+    const int FINGERPRINT_LENGTH = 4;
+    /// @brief hash of a frame too uniform to tell ads apart (e.g. a fade), skipped when comparing fingerprints
+    const uint64_t UNIFORM_FRAME_HASH = 0;
+
+    /// @brief struct camicasa::AdIndexHeader at the start of the file of a camicasa::AdIndex
+    struct AdIndexHeader {
+        char magic[8];
+        int32_t version;
+        int32_t count;
+        /// @brief number of entries of each table
+        int32_t entries;
+        /// @brief padding, so the records that follow the header in the mapped file are aligned to their hashes
+        int32_t reserved;
+    };
+
+    /// @brief struct camicasa::AdRecord describing an ad of a camicasa::AdIndex by the hashes of its first seconds
+    struct AdRecord {
+        int32_t id;
+        /// @brief duration in milliseconds of the first airing
+        int32_t duration;
+        uint64_t hashes[FINGERPRINT_LENGTH];
+    };
+
+    /// @brief struct camicasa::AdBandEntry pointing from 16 bits of the hash of a frame to the ad it was taken from
+    struct AdBandEntry {
+        uint16_t value;
+        uint16_t position;
+        int32_t record;
+    };
+
+    /**
+        @brief class camicasa::AdIndex keeping the fingerprints of the ads found by every run on disk, so an ad airing again is
+        recognised from its first seconds
+        @note The file (directory/ads.bin) holds the records, followed by a table per 16 bits of the hashes sorted by their
+        value and position. Hashes at most 3 bits apart share the bits of at least one table, so candidates are found with a binary search
+        per table instead of comparing every record. The file is mapped in memory, and ads added during the run are kept
+        apart until camicasa::AdIndex::merge
+    */
+    class AdIndex {
+    private:
+        /// @brief directory of the index
+        string directory;
+        /// @brief memory where the file is mapped, NULL if there is none
+        void *mapping;
+        /// @brief size of the mapped file in bytes
+        size_t mappingSize;
+        /// @brief ads added since the file was mapped
+        vector<AdRecord> pending;
+        /// @brief identifier of the next ad added
+        int nextId;
+        /// @brief guards the ads added, as copies of a camicasa::TVChannel (e.g. chunks) share the index
+        mutex pendingMutex;
+
+        /// @brief method for unmapping the file
+        void close();
+
+        /// @brief method for checking the mapped file, unmapping it if it is not valid
+        bool isValid();
+
+        /// @brief method for finding the mapped ad closest to the fingerprint, -1 if none is close enough
+        int findMapped(const vector<uint64_t> &fingerprint, int &distance, int *duration = NULL);
+
+        /// @brief method for merging the ads added while holding the lock of the index
+        int mergeLocked(map<int, int> &identifiers);
+
+    public:
+        /**
+            @brief constructor of class camicasa::AdIndex
+            @param directory directory of the index, created if it does not exist
+        */
+        AdIndex(string directory);
+
+        /// @brief destructor of class camicasa::AdIndex
+        ~AdIndex();
+
+        /**
+            @brief The function camicasa::AdIndex::open maps the file of the index in memory
+            @returns returns true if the index has a file
+        */
+        bool open();
+
+        /// @returns returns the number of ads known, mapped and added
+        int size();
+
+        /**
+            @brief The function camicasa::AdIndex::find looks for a known ad with the given fingerprint
+            @param fingerprint hashes of the first seconds of a segment, as computed by camicasa::hashFrame()
+            @param[out] duration optional duration in milliseconds of the first airing of the ad found (default is NULL)
+            @returns returns the identifier of the ad, -1 if there is none
+            @note An ad is a candidate only if a hash of the fingerprint shares the 16 bits of a table with the ad, which is certain
+            when it is at most 3 bits away (4 tables of 16 bits) and likelier the closer it is. A candidate is then the ad if at
+            least 2 hashes of frames that are not uniform are each at most 10 bits away. Ads of the run are looked for the same way,
+            so they are found as they will be once merged
+        */
+        int find(const vector<uint64_t> &fingerprint, int *duration = NULL);
+
+        /**
+            @brief The function camicasa::AdIndex::add adds an ad found during the run, so it is recognised when it airs again
+            @param fingerprint hashes of the first seconds of the ad
+            @param duration duration of the ad in milliseconds
+            @returns returns the identifier of the ad (of the known one if it was already there), -1 if the fingerprint cannot
+            tell ads apart
+        */
+        int add(const vector<uint64_t> &fingerprint, int duration);
+
+        /**
+            @brief The function camicasa::AdIndex::merge writes the ads added during the run, replacing the file at once and
+            mapping the new one
+            @param[out] identifiers identifier in the file of each ad added during the run, by the identifier camicasa::AdIndex::add
+            returned
+            @returns returns the number of ads written, -1 if the file could not be written
+            @note Runs merging at the same time take turns. Ads another run wrote meanwhile are not written twice, and ads added
+            get new identifiers if another run took theirs, so the segments must be reported with the identifiers given back
+        */
+        int merge(map<int, int> &identifiers);
+    };
+
+    /**
+        @brief The function camicasa::hashFrame computes the difference hash of a frame: 64 bits telling whether each pixel of the
+        frame shrunk to 9x8 is brighter than the next one in its row
+        @param frame image frame input cv::Mat, in color or grayscale at any size
+        @returns returns the hash, camicasa::UNIFORM_FRAME_HASH if the frame is too uniform
+        @note The hash survives scaling, compression and small changes of brightness, so airings of an ad at other qualities
+        give hashes a few bits apart
+    */
+    uint64_t hashFrame(const Mat &frame);
+
+    /// @returns returns the number of bits the hashes differ in
+    int hashDistance(uint64_t first, uint64_t second);
+
+}
+
+#endif
@@ -0,0 +1,639 @@
+#include <opencv2/opencv.hpp>
+#include <iostream>
+#include <chrono>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <thread>
+#include <fstream>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+#include "utils.hpp"
+#include "pipeline.hpp"
+#include "adindex.hpp"
+
+using namespace std;
+using namespace cv;
+using namespace camicasa;
+
+
+/// @brief number of heap allocations made with operator new
+atomic<long> heapAllocations(0);
+
+void* operator new(size_t size)
+{
+    heapAllocations++;
+
+    void *pointer = malloc(size ? size : 1);
+    if (!pointer)
+        throw bad_alloc();
+
+    return pointer;
+}
+
+void operator delete(void *pointer) noexcept
+{
+    free(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept
+{
+    free(pointer);
+}
+
+/// @brief class CountingAllocator counting the cv::Mat buffers allocated, which do not go through operator new
+class CountingAllocator : public MatAllocator {
+public:
+    /// @brief allocator doing the work
+    MatAllocator *allocator;
+    /// @brief number of buffers allocated
+    mutable atomic<long> allocations;
+
+    CountingAllocator(MatAllocator *allocator) : allocations(0) {
+        this->allocator = allocator;
+    }
+
+    UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step, AccessFlag flags, UMatUsageFlags usageFlags) const override {
+        // headers over existing data do not allocate a buffer
+        if (!data)
+            this->allocations++;
+
+        return this->allocator->allocate(dims, sizes, type, data, step, flags, usageFlags);
+    }
+
+    bool allocate(UMatData* data, AccessFlag accessFlags, UMatUsageFlags usageFlags) const override {
+        return this->allocator->allocate(data, accessFlags, usageFlags);
+    }
+
+    void deallocate(UMatData* data) const override {
+        this->allocator->deallocate(data);
+    }
+};
+
+
+/// @brief struct BenchmarkResult with the measures of a function on an input, written to the output file
+struct BenchmarkResult {
+    string function;
+    string resolution;
+    string input;
+    double nanoseconds;
+    double heapAllocations;
+    double matAllocations;
+};
+
+/// @brief results of the hot functions, in the order measured
+vector<BenchmarkResult> results;
+
+
+/**
+    @brief Black frame detection as done before the vectorized kernel, used as reference
+    @param frame image frame input cv::Mat
+    @param threshold threshold to compare
+    @returns returns true if the average of the pixels is under the threshold
+*/
+bool referenceThresholdDetection(Mat &frame, int threshold)
+{
+    Scalar mean = cv::mean(frame);
+
+    int avg = (mean(0) + mean(1) + mean(2)) / (frame.channels());
+
+    return (avg <= threshold);
+}
+
+/**
+    @brief Time a black frame detection
+    @param detection function to time
+    @param iterations number of calls
+    @param[out] answer answer of the last call
+    @returns returns the average time of a call in nanoseconds
+*/
+template <typename Detection>
+double timeDetection(Detection detection, int iterations, bool &answer)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+        answer = detection();
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    return chrono::duration<double, nano>(end - start).count() / iterations;
+}
+
+/**
+    @brief Measure the steady state of camicasa::TVChannel::processFrame on frames with a known logo in a corner
+    @param size size of the frames
+    @param iterations number of frames measured
+    @param allocator counter of the cv::Mat buffers allocated
+*/
+void benchmarkFrameLoop(Size size, int iterations, CountingAllocator &allocator)
+{
+    int fps = 25;
+    TVChannel channel(size.width, size.height, fps, 60);
+
+    vector<Mat> frames(8);
+    for (int i = 0; i < frames.size(); i++){
+        frames[i].create(size, CV_8UC3);
+        randu(frames[i], Scalar::all(16), Scalar::all(256));
+    }
+
+    // a logo that is not on the frames, so it is compared on every frame
+    Logo logo;
+    logo.x = size.width / 50;
+    logo.y = size.height / 50;
+    logo.width = size.width / 16;
+    logo.height = size.height / 18;
+    logo.screenCorner = TOP_LEFT;
+    logo.image = Mat(Size(logo.width, logo.height), CV_8UC3, Scalar::all(0));
+    rectangle(logo.image, Rect(logo.width / 4, logo.height / 4, logo.width / 2, logo.height / 2), Scalar::all(255), FILLED);
+    channel.addLogo(logo);
+
+    // warm up until every buffer was used once (at least two sampled frames)
+    int frameNumber = 1;
+    for (; frameNumber <= 3 * fps; frameNumber++)
+        channel.processFrame(frames[frameNumber % frames.size()], frameNumber * 1000 / fps, frameNumber);
+
+    long heapBefore = heapAllocations;
+    long matBefore = allocator.allocations;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++, frameNumber++)
+        channel.processFrame(frames[frameNumber % frames.size()], frameNumber * 1000 / fps, frameNumber);
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    cout << size.width << "x" << size.height << " " << (long)(chrono::duration<double, nano>(end - start).count() / iterations) << " "
+         << (double)(heapAllocations - heapBefore) / iterations << " "
+         << (double)(allocator.allocations - matBefore) / iterations << "\n";
+}
+
+/**
+    @brief Measure camicasa::TVChannel::matchLogos with many logos in a corner, on frames where none of them is
+    @param logoCount number of logos of the channel
+    @param iterations number of frames measured
+*/
+void benchmarkLogoFilter(int logoCount, int iterations)
+{
+    Size size(1280, 720);
+    TVChannel channel(size.width, size.height, 25, 60);
+
+    srand(logoCount);
+
+    // overlapping logos inside the top left corner region
+    for (int i = 0; i < logoCount; i++){
+        Logo logo;
+        logo.id = i + 1;
+        logo.x = 8 + (i % 8) * 12;
+        logo.y = 8 + (i / 8 % 8) * 12;
+        logo.width = 64;
+        logo.height = 32;
+        logo.screenCorner = TOP_LEFT;
+        logo.image = Mat(Size(logo.width, logo.height), CV_8UC3, Scalar::all(0));
+        rectangle(logo.image, Rect(rand() % 32, rand() % 16, 24, 12), Scalar::all(255), FILLED);
+        channel.addLogo(logo);
+    }
+
+    // a flat corner has no edges at all, a noisy one has edges everywhere
+    vector<pair<string, Mat>> frames;
+    frames.push_back(make_pair("flat", Mat(size, CV_8UC3, Scalar::all(60))));
+
+    Mat noise(size, CV_8UC3);
+    randu(noise, Scalar::all(0), Scalar::all(256));
+    frames.push_back(make_pair("noise", noise));
+
+    vector<LogoMatch> matches;
+
+    for (int i = 0; i < frames.size(); i++){
+        Mat &frame = frames[i].second;
+        channel.matchLogos(frame, matches);
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for (int j = 0; j < iterations; j++)
+            channel.matchLogos(frame, matches);
+
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+        double time = chrono::duration<double, nano>(end - start).count() / iterations;
+
+        cout << logoCount << " " << frames[i].first << " " << (long)time << " " << (long)(time / logoCount) << " "
+             << matches.size() << "\n";
+    }
+}
+
+/**
+    @brief Measure the threshold check of many regions of a grayscale frame, cropping each one against a single
+    camicasa::RegionStatistics pass
+    @param regionCount number of regions, on a grid over the frame
+    @param iterations number of frames measured
+*/
+void benchmarkRegionStatistics(int regionCount, int iterations)
+{
+    Size size(1280, 720);
+
+    Mat frame(size, CV_8UC1);
+    randu(frame, Scalar::all(0), Scalar::all(12));
+
+    // a square grid of regions, each one a cell of the frame
+    int side = (int)ceil(sqrt((double)regionCount));
+    vector<Rect> regions;
+    for (int i = 0; i < regionCount; i++)
+        regions.push_back(Rect((i % side) * size.width / side, (i / side) * size.height / side, size.width / side, size.height / side));
+
+    RegionStatistics statistics;
+    int same = 0;
+    int answers = 0;
+
+    bool answer;
+    double cropTime = timeDetection([&]() {
+        answers = 0;
+        for (int i = 0; i < regions.size(); i++){
+            Mat region = frame(regions[i]);
+            answers += screenThresholdDetection(region, CHECK_SMALLER, 5);
+        }
+        return answers > 0;
+    }, iterations, answer);
+
+    double integralTime = timeDetection([&]() {
+        same = 0;
+        statistics.compute(frame, false);
+        for (int i = 0; i < regions.size(); i++)
+            same += statistics.thresholdDetection(regions[i], CHECK_SMALLER, 5);
+        return same > 0;
+    }, iterations, answer);
+
+    cout << regionCount << " " << (long)cropTime << " " << (long)integralTime << " " << cropTime / integralTime << " "
+         << (same == answers ? "yes" : "no") << "\n";
+}
+
+/**
+    @brief Measure how long finding an ad takes in a camicasa::AdIndex growing to each of the given numbers of ads, with
+    random fingerprints
+    @param adCounts numbers of ads measured, in increasing order
+    @param iterations number of lookups measured
+*/
+void benchmarkAdIndex(vector<int> adCounts, int iterations)
+{
+    char directory[] = "/tmp/sic-benchmark-XXXXXX";
+    if (mkdtemp(directory) == NULL){
+        puts("Error creating the directory of the ad index");
+        return;
+    }
+
+    mt19937_64 random(1);
+    vector<vector<uint64_t>> stored;
+
+    AdIndex index(directory);
+    index.open();
+
+    for (int i = 0; i < adCounts.size(); i++){
+        // added and merged in batches, as runs would
+        while (stored.size() < adCounts[i]){
+            for (int j = 0; j < 5000 && stored.size() < adCounts[i]; j++){
+                vector<uint64_t> fingerprint;
+                for (int k = 0; k < FINGERPRINT_LENGTH; k++)
+                    fingerprint.push_back(random());
+
+                index.add(fingerprint, 30000);
+                stored.push_back(fingerprint);
+            }
+            map<int, int> identifiers;
+            index.merge(identifiers);
+        }
+
+        // another airing of a stored ad, a few bits of each hash apart, and a segment that is no ad
+        vector<vector<uint64_t>> airings;
+        vector<vector<uint64_t>> others;
+
+        for (int j = 0; j < iterations; j++){
+            vector<uint64_t> airing = stored[random() % stored.size()];
+            vector<uint64_t> other;
+
+            for (int k = 0; k < FINGERPRINT_LENGTH; k++){
+                for (int bit = 0; bit < 3; bit++)
+                    airing[k] ^= 1ULL << (random() % 64);
+                other.push_back(random());
+            }
+
+            airings.push_back(airing);
+            others.push_back(other);
+        }
+
+        int hits = 0;
+        auto start = chrono::steady_clock::now();
+        for (int j = 0; j < iterations; j++)
+            hits += index.find(airings[j]) != -1;
+        double hitTime = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+
+        int misses = 0;
+        start = chrono::steady_clock::now();
+        for (int j = 0; j < iterations; j++)
+            misses += index.find(others[j]) == -1;
+        double missTime = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / iterations;
+
+        cout << index.size() << " " << (long)hitTime << " " << (long)missTime << " " << (double)hits / iterations << " "
+             << (double)misses / iterations << "\n";
+    }
+
+    unlink((string(directory) + "/ads.bin").c_str());
+    unlink((string(directory) + "/ads.lock").c_str());
+    rmdir(directory);
+}
+
+/**
+    @brief Measure the time and allocations of a call, after a first call that allocates its buffers
+    @param function name of the function measured
+    @param size size of the frames
+    @param input name of the input (fixture or synthetic)
+    @param iterations number of calls measured
+    @param allocator counter of the cv::Mat buffers allocated
+    @param call function to measure
+*/
+template <typename Call>
+void measure(string function, Size size, string input, int iterations, CountingAllocator &allocator, Call call)
+{
+    call();
+
+    long heapBefore = heapAllocations;
+    long matBefore = allocator.allocations;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for (int i = 0; i < iterations; i++)
+        call();
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    BenchmarkResult result;
+    result.function = function;
+    result.resolution = to_string(size.width) + "x" + to_string(size.height);
+    result.input = input;
+    result.nanoseconds = chrono::duration<double, nano>(end - start).count() / iterations;
+    result.heapAllocations = (double)(heapAllocations - heapBefore) / iterations;
+    result.matAllocations = (double)(allocator.allocations - matBefore) / iterations;
+
+    cout << result.function << " " << result.resolution << " " << result.input << " " << (long)result.nanoseconds << " "
+         << result.heapAllocations << " " << result.matAllocations << "\n";
+
+    results.push_back(result);
+}
+
+/**
+    @brief Measure the functions of the logo search on a frame: black frame detection, still tiles, logo search and cropping, 
+    morphology and pattern matching
+    @param frame image frame input cv::Mat, with the logo at the given area
+    @param logoImage image of the logo, empty to draw one
+    @param logoArea area of the logo in the frame
+    @param input name of the input
+    @param iterations number of calls measured
+    @param allocator counter of the cv::Mat buffers allocated
+*/
+void benchmarkHotFunctions(Mat &frame, Mat logoImage, Rect logoArea, string input, int iterations, CountingAllocator &allocator)
+{
+    Size size(frame.cols, frame.rows);
+
+    // every tile with still pixels is searched at once
+    TVChannel channel(size.width, size.height, 25, 1);
+
+    Logo logo;
+    logo.x = logoArea.x;
+    logo.y = logoArea.y;
+    logo.width = logoArea.width;
+    logo.height = logoArea.height;
+    logo.screenCorner = TOP_LEFT;
+
+    if (logoImage.empty()){
+        logo.image = Mat(logoArea.size(), CV_8UC3, Scalar::all(0));
+        rectangle(logo.image, Rect(logo.width / 4, logo.height / 4, logo.width / 2, logo.height / 2), Scalar::all(255), FILLED);
+    }
+    else
+        resize(logoImage, logo.image, logoArea.size(), 0, 0, INTER_AREA);
+
+    // the still pixels of a frame with a logo: only the logo survives the bitwise_and of the sampled frames
+    Mat bitwise(size, CV_8UC3, Scalar::all(0));
+    logo.image.copyTo(bitwise(logoArea));
+
+    Mat bitwiseGray;
+    convertToGray(bitwise, bitwiseGray);
+
+    channel.checkForSaturatedTiles(bitwiseGray, CHECK_SMALLER, 5);
+
+    // the tile cropped by findLogos, with its binarization as extractLogos does it
+    Rect tile = channel.getTiles()[0];
+    Mat croppedOriginal = frame(tile);
+    Mat croppedBitwise = bitwise(tile);
+
+    Mat binarized;
+    threshold(bitwiseGray(tile), binarized, 0, 255, THRESH_OTSU);
+
+    vector<Logo> logos;
+    vector<Logo> extracted;
+    Logo cropped;
+    Mat morphed;
+
+    measure("screenThresholdDetection", size, input, iterations, allocator, [&]() { screenThresholdDetection(frame, CHECK_SMALLER, 1); });
+    measure("checkForSaturatedTiles", size, input, iterations, allocator, [&]() { channel.checkForSaturatedTiles(bitwiseGray, CHECK_SMALLER, 5); });
+    measure("findLogos", size, input, iterations, allocator, [&]() { channel.findLogos(frame, bitwise, logos); });
+    measure("extractLogos", size, input, iterations, allocator, [&]() { extractLogos(croppedOriginal, croppedBitwise, extracted); });
+    measure("cropLogo", size, input, iterations, allocator, [&]() { cropLogo(croppedOriginal, croppedBitwise, cropped); });
+    measure("morphOperation", size, input, iterations, allocator, [&]() { morphOperation(binarized, morphed); });
+    measure("findPatternLogo", size, input, iterations, allocator, [&]() { channel.findPatternLogo(frame, logo); });
+    measure("hashFrame", size, input, iterations, allocator, [&]() { hashFrame(frame); });
+}
+
+/**
+    @brief Measure how fast an input is decoded with a backend and a number of decoder threads
+    @param source path of the input
+    @param backendName name of the backend, as given to camicasa::parseBackend
+    @param threads number of decoder threads, 0 to let the backend choose
+    @param frameCount maximum number of frames decoded
+*/
+void benchmarkDecoding(string source, string backendName, int threads, int frameCount)
+{
+    VideoOptions options;
+    options.backend = parseBackend(backendName);
+    options.decoderThreads = threads;
+
+    VideoCapture vidCapture;
+    if (!openInput(vidCapture, source, options)){
+        cout << backendName << " " << threads << " unavailable\n";
+        return;
+    }
+
+    Mat frame;
+    int frames = 0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    while (frames < frameCount && vidCapture.read(frame))
+        frames++;
+
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+    double seconds = chrono::duration<double>(end - start).count();
+
+    // the threads the backend applied, which may differ from the ones asked for
+    cout << backendName << " " << threads << " " << vidCapture.getBackendName() << " " << (int)vidCapture.get(CAP_PROP_N_THREADS)
+         << " " << frames << " " << (seconds > 0 ? frames / seconds : 0) << "\n";
+}
+
+int main(int argc, char** argv)
+{
+    int iterations = 200;
+    // decoding is only measured on a given input
+    string source;
+    // the results of the hot functions are also written as CSV to compare runs
+    string output;
+
+    // a path may start with digits (e.g. 2024-05-01.ts), so only a whole number that is no file counts as iterations
+    for (int i = 1; i < argc; i++){
+        if (!strcmp(argv[i], "--output") && i + 1 < argc)
+            output = argv[++i];
+        else if (!strcmp(argv[i], "--iterations") && i + 1 < argc)
+            iterations = max(1, atoi(argv[++i]));
+        else if (argv[i][0] != '\0' && strspn(argv[i], "0123456789") == strlen(argv[i]) && access(argv[i], F_OK) != 0)
+            iterations = max(1, atoi(argv[i]));
+        else
+            source = argv[i];
+    }
+
+    CountingAllocator allocator(Mat::getStdAllocator());
+    Mat::setDefaultAllocator(&allocator);
+
+    vector<Size> resolutions = {Size(1280, 720), Size(1920, 1080)};
+    vector<int> strides = {1, 2, 4, 8};
+
+    puts("**** BLACK FRAME DETECTION ****");
+    puts("resolution frame stride reference_ns kernel_ns speedup same_answer");
+
+    for (int i = 0; i < resolutions.size(); i++)
+    {
+        Size size = resolutions[i];
+
+        // a black frame has to be read whole, a bright one stops early
+        vector<pair<string, Mat>> frames;
+        frames.push_back(make_pair("black", Mat(size, CV_8UC3, Scalar::all(0))));
+
+        Mat dark(size, CV_8UC3);
+        randu(dark, Scalar::all(0), Scalar::all(3));
+        frames.push_back(make_pair("dark", dark));
+
+        Mat bright(size, CV_8UC3);
+        randu(bright, Scalar::all(0), Scalar::all(256));
+        frames.push_back(make_pair("bright", bright));
+
+        for (int j = 0; j < frames.size(); j++)
+        {
+            Mat &frame = frames[j].second;
+
+            bool reference;
+            double referenceTime = timeDetection([&]() { return referenceThresholdDetection(frame, 1); }, iterations, reference);
+
+            for (int k = 0; k < strides.size(); k++)
+            {
+                int stride = strides[k];
+
+                bool answer;
+                double time = timeDetection([&]() { return screenThresholdDetection(frame, CHECK_SMALLER, 1, stride); }, iterations, answer);
+
+                cout << size.width << "x" << size.height << " " << frames[j].first << " " << stride << " "
+                     << (long)referenceTime << " " << (long)time << " " << referenceTime / time << " "
+                     << (answer == reference ? "yes" : "no") << "\n";
+            }
+        }
+    }
+
+    puts("");
+    puts("**** FRAME LOOP ****");
+    puts("resolution ns_per_frame heap_allocations_per_frame mat_allocations_per_frame");
+
+    for (int i = 0; i < resolutions.size(); i++)
+        benchmarkFrameLoop(resolutions[i], iterations, allocator);
+
+    puts("");
+    puts("**** LOGO MATCHING ****");
+    puts("logos frame ns_per_frame ns_per_logo matches");
+
+    vector<int> logoCounts = {1, 16, 64};
+
+    for (int i = 0; i < logoCounts.size(); i++)
+        benchmarkLogoFilter(logoCounts[i], iterations);
+
+    puts("");
+    puts("**** REGION STATISTICS ****");
+    puts("regions crop_ns integral_ns speedup same_answer");
+
+    vector<int> regionCounts = {4, 16, 64, 256};
+
+    for (int i = 0; i < regionCounts.size(); i++)
+        benchmarkRegionStatistics(regionCounts[i], iterations);
+
+    puts("");
+    puts("**** HOT FUNCTIONS ****");
+    puts("function resolution input ns_per_call heap_allocations_per_call mat_allocations_per_call");
+
+    // the fixture frame of teste.cpp, with its logo where teste.cpp looks for it
+    Mat fixtureFrame = imread("testeLogo/frame1.jpg");
+    Mat fixtureLogo = imread("testeLogo/logo1.jpg");
+    Rect fixtureArea(94, 33, 66, 35);
+
+    if (fixtureFrame.empty())
+        puts("testeLogo/frame1.jpg not found, measuring synthetic frames only");
+
+    vector<Size> hotResolutions = {Size(854, 480), Size(1280, 720), Size(1920, 1080)};
+
+    for (int i = 0; i < hotResolutions.size(); i++)
+    {
+        Size size = hotResolutions[i];
+        double scale = size.width / 1280.0;
+        Rect logoArea((int)(fixtureArea.x * scale), (int)(fixtureArea.y * scale), (int)(fixtureArea.width * scale), (int)(fixtureArea.height * scale));
+
+        Mat noise(size, CV_8UC3);
+        randu(noise, Scalar::all(0), Scalar::all(256));
+        benchmarkHotFunctions(noise, Mat(), logoArea, "synthetic", iterations, allocator);
+
+        if (fixtureFrame.empty())
+            continue;
+
+        Mat frame;
+        resize(fixtureFrame, frame, size, 0, 0, INTER_AREA);
+        benchmarkHotFunctions(frame, fixtureLogo, logoArea, "frame1", iterations, allocator);
+    }
+
+    Mat::setDefaultAllocator(NULL);
+
+    puts("");
+    puts("**** AD INDEX ****");
+    puts("ads ns_per_known_ad ns_per_unknown_ad known_found unknown_not_found");
+
+    benchmarkAdIndex({1000, 10000, 100000, 300000}, iterations);
+
+    if (!output.empty()){
+        ofstream file(output);
+
+        file << "function,resolution,input,ns_per_call,heap_allocations_per_call,mat_allocations_per_call\n";
+        for (int i = 0; i < results.size(); i++)
+            file << results[i].function << "," << results[i].resolution << "," << results[i].input << "," << (long)results[i].nanoseconds << ","
+                 << results[i].heapAllocations << "," << results[i].matAllocations << "\n";
+
+        if (!file)
+            puts("Error writing benchmark results");
+    }
+
+    if (!source.empty()){
+        puts("");
+        puts("**** DECODING ****");
+        puts("backend threads opened_backend applied_threads frames fps");
+
+        vector<string> backends = {"any", "ffmpeg", "gstreamer"};
+        vector<int> threads = {0, 1, 2, 4, (int)thread::hardware_concurrency()};
+
+        for (int i = 0; i < backends.size(); i++)
+            for (int j = 0; j < threads.size(); j++)
+                benchmarkDecoding(source, backends[i], threads[j], 10 * iterations);
+    }
+
+    return 0;
+}
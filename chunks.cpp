@@ -0,0 +1,133 @@
+#include "chunks.hpp"
+#include "pipeline.hpp"
+#include "scheduler.hpp"
+#include "trace.hpp"
+
+using namespace camicasa;
+
+vector<Chunk> camicasa::splitChunks(int frameCount, int count)
+{
+    vector<Chunk> chunks;
+
+    for (int i = 0; i < count; i++){
+        Chunk chunk;
+        chunk.startFrame = (int)((long long)frameCount * i / count);
+        chunk.endFrame = (int)((long long)frameCount * (i + 1) / count);
+
+        if (chunk.endFrame > chunk.startFrame)
+            chunks.push_back(chunk);
+    }
+
+    return chunks;
+}
+
+void camicasa::analyzeChunk(string source, TVChannel channel, Chunk *chunk, int samplingStep, VideoOptions options)
+{
+    nameTraceThread("chunk " + to_string(chunk->startFrame));
+
+    VideoCapture vidCapture;
+    openInput(vidCapture, source, options);
+
+    if (!vidCapture.isOpened()){
+        puts("Error opening video stream or file");
+        return;
+    }
+
+    vidCapture.set(CAP_PROP_POS_FRAMES, chunk->startFrame);
+
+    FrameScheduler scheduler(&channel, vidCapture.get(CAP_PROP_FPS), samplingStep);
+
+    DecodedFrame decoded;
+    int timestamp = 0;
+    bool firstFrame = true;
+
+    // frameNumber is the position after reading, so the frame read is frameNumber - 1
+    while (scheduler.read(vidCapture, decoded, channel.getAnalysisScale()) && decoded.frameNumber <= chunk->endFrame){
+        timestamp = decoded.timestamp;
+
+        if (firstFrame){
+            chunk->startTimestamp = timestamp;
+            firstFrame = false;
+        }
+
+        channel.processFrame(decoded.analysisFrame, timestamp, decoded.frameNumber, decoded.black);
+    }
+
+    chunk->openAtEnd = channel.finishStream(timestamp) & SEGMENT_CLOSED;
+    chunk->segments = channel.getSegments();
+    chunk->logos = channel.getLogos();
+
+    vidCapture.release();
+}
+
+void camicasa::stitchChunks(vector<Chunk> &chunks, TVChannel *channel)
+{
+    // logos the channel already knew (e.g. from a logo library) keep their identifiers
+    vector<Logo> logos = channel->getLogos();
+    int knownLogos = logos.size();
+    vector<Segment> segments;
+
+    for (int i = 0; i < chunks.size(); i++){
+        Chunk &chunk = chunks[i];
+
+        // map the identifiers of the chunk logos to the stitched ones
+        map<int, int> logoIds;
+
+        for (int j = 0; j < chunk.logos.size(); j++){
+            Logo logo = chunk.logos[j];
+
+            int id = -1;
+            for (int k = 0; k < logos.size() && id == -1; k++)
+                if (isSameLogo(logos[k], logo))
+                    id = logos[k].id;
+
+            if (id == -1){
+                id = logos.empty() ? 1 : logos.back().id + 1;
+                logo.id = id;
+                logos.push_back(logo);
+            }
+
+            logoIds[chunk.logos[j].id] = id;
+        }
+
+        for (int j = 0; j < chunk.segments.size(); j++){
+            Segment segment = chunk.segments[j];
+
+            if (segment.logoAssociated != -1)
+                segment.logoAssociated = logoIds[segment.logoAssociated];
+
+            bool crossesBoundary = (j == 0 && i > 0 && chunks[i - 1].openAtEnd && !segments.empty());
+
+            if (crossesBoundary && segment.startTimestamp == chunk.startTimestamp){
+                Segment &previous = segments.back();
+
+                previous.endTimestamp = segment.endTimestamp;
+
+                if (segment.type == PROGRAM)
+                    previous.type = PROGRAM;
+
+                if (previous.logoAssociated == -1)
+                    previous.logoAssociated = segment.logoAssociated;
+
+                // neither half may have lasted long enough on its own
+                if (previous.type != PROGRAM && previous.adAssociated == -1 && channel->hasMinimumTimePassed((previous.endTimestamp - previous.startTimestamp) / 1000))
+                    previous.type = PROGRAM;
+
+                continue;
+            }
+
+            // the chunk starts with a black frame, which is what closes the open segment
+            if (crossesBoundary)
+                segments.back().endTimestamp = chunk.startTimestamp;
+
+            segment.id = segments.size() + 1;
+            segments.push_back(segment);
+        }
+    }
+
+    for (int i = knownLogos; i < logos.size(); i++)
+        channel->addLogo(logos[i]);
+
+    for (int i = 0; i < segments.size(); i++)
+        channel->addSegment(segments[i]);
+}
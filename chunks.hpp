@@ -0,0 +1,56 @@
+#ifndef _CHUNKS_
+#define _CHUNKS_
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include <map>
+#include "utils.hpp"
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief struct camicasa::Chunk containing a range of frames of the input and the result of its analysis
+    struct Chunk {
+        int startFrame = 0;
+        int endFrame = 0;
+        int startTimestamp = 0;
+        bool openAtEnd = false;
+        vector<Segment> segments;
+        vector<Logo> logos;
+    };
+
+    /**
+        @brief The function camicasa::splitChunks divides the frames of the input in ranges of the same size
+        @param frameCount number of frames of the input
+        @param count number of ranges
+        @returns returns a vector of camicasa::Chunk with the frame ranges filled
+    */
+    vector<Chunk> splitChunks(int frameCount, int count);
+
+    /**
+        @brief The function camicasa::analyzeChunk detects logos and classifies the segments of a range of frames with its own
+        camicasa::TVChannel
+        @param source path of the input
+        @param channel copy of a camicasa::TVChannel not yet used, with the settings of the analysis
+        @param chunk camicasa::Chunk with the range to analyse, receiving the segments and logos found
+        @param samplingStep optional maximum number of frames between analysed frames, 1 to analyse all of them (default is 1)
+        @param options optional camicasa::VideoOptions the input is opened with (default is none)
+        @note See more in camicasa::FrameScheduler
+    */
+    void analyzeChunk(string source, TVChannel channel, Chunk *chunk, int samplingStep = 1, VideoOptions options = VideoOptions());
+
+    /**
+        @brief The function camicasa::stitchChunks adds the segments and logos of all chunks to the channel, merging segments that
+        cross the chunk boundaries and renumbering segments and logos
+        @param chunks analysed camicasa::Chunk in order
+        @param channel camicasa::TVChannel receiving the stitched segments and logos
+        @note Merged segments are promoted to PROGRAM if their whole duration passes camicasa::TVChannel::hasMinimumTimePassed()
+    */
+    void stitchChunks(vector<Chunk> &chunks, TVChannel *channel);
+
+}
+
+#endif
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <fstream>
+#include "events.hpp"
+
+using namespace std;
+using namespace camicasa;
+
+
+int main(int argc, char** argv)
+{
+    if (argc < 2){
+        puts("Usage: compact <events.ndjson> [json.json]");
+        return 0;
+    }
+
+    ifstream stream(argv[1]);
+
+    if (!stream.is_open()){
+        puts("Error opening event log");
+        return 1;
+    }
+
+    Json::Value json = compactEvents(stream);
+
+    string path = (argc > 2) ? argv[2] : "json.json";
+    if (!writeJsonFile(path, json))
+        return 1;
+
+    cout << json["logos"].size() << " logos and " << json["segments"].size() << " segments written to " << path << "\n";
+
+    return 0;
+}
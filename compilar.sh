@@ -1 +1,3 @@
-g++ sic.cpp utils.cpp -o app `pkg-config --cflags --libs opencv4` -ljsoncpp
\ No newline at end of file
+g++ -O3 -march=native sic.cpp utils.cpp adindex.cpp pipeline.cpp chunks.cpp streamcopy.cpp events.cpp library.cpp scheduler.cpp frameindex.cpp trace.cpp -o app -pthread `pkg-config --cflags --libs opencv4` -ljsoncpp
+g++ -O3 -march=native benchmark.cpp utils.cpp adindex.cpp pipeline.cpp trace.cpp -o benchmark -pthread `pkg-config --cflags --libs opencv4`
+g++ -O3 -march=native compact.cpp events.cpp utils.cpp adindex.cpp pipeline.cpp trace.cpp -o compact -pthread `pkg-config --cflags --libs opencv4` -ljsoncpp
\ No newline at end of file
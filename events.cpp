@@ -0,0 +1,146 @@
+#include "events.hpp"
+#include <map>
+#include <cmath>
+#include <cstdio>
+
+using namespace camicasa;
+
+/// @brief Build a writer of single line json
+static Json::StreamWriter* compactWriter()
+{
+    Json::StreamWriterBuilder builder;
+    builder["indentation"] = "";
+
+    return builder.newStreamWriter();
+}
+
+camicasa::EventLog::EventLog(string path, bool append) : writer(compactWriter()) {
+    this->file.open(path, append ? ios::app : ios::trunc);
+
+    if (!this->file.is_open())
+        puts("Error opening event log");
+}
+
+camicasa::EventLog::~EventLog() {
+    this->file.close();
+}
+
+bool camicasa::EventLog::isOpen() {
+    return this->file.is_open();
+}
+
+void camicasa::EventLog::write(string event, int timestamp, const Json::Value &data) {
+    if (!this->file.is_open())
+        return;
+
+    Json::Value line;
+    line["event"] = event;
+    line["timestamp"] = timestamp;
+    line["data"] = data;
+
+    this->writer->write(line, &this->file);
+    this->file << "\n";
+    this->file.flush();
+}
+
+Json::Value camicasa::segmentToJson(const Segment &segment)
+{
+    Json::Value segmentJson;
+
+    segmentJson["id"] = segment.id;
+    segmentJson["startTimestamp"] = segment.startTimestamp;
+    segmentJson["endTimestamp"] = segment.endTimestamp;
+    segmentJson["type"] = stringifyTVChannelType(segment.type);
+    segmentJson["logoFound"] = segment.logoAssociated;
+    segmentJson["adFound"] = segment.adAssociated;
+
+    return segmentJson;
+}
+
+Json::Value camicasa::logoToJson(const Logo &logo, double analysisScale)
+{
+    double scale = (analysisScale > 0) ? analysisScale : 1;
+
+    Json::Value logoJson;
+
+    logoJson["id"] = logo.id;
+    logoJson["x"] = (int)round(logo.x / scale);
+    logoJson["y"] = (int)round(logo.y / scale);
+    logoJson["width"] = (int)round(logo.width / scale);
+    logoJson["height"] = (int)round(logo.height / scale);
+    logoJson["corner"] = stringifyScreenCorner(logo.screenCorner);
+
+    return logoJson;
+}
+
+Json::Value camicasa::compactEvents(istream &stream)
+{
+    Json::Value logoVec(Json::arrayValue);
+    Json::Value segmentVec(Json::arrayValue);
+
+    // by identifier, since an analysis resumed from a checkpoint repeats the events after it
+    map<int, Json::Value> logos;
+    // segments by identifier, so the exported ones replace the classified ones
+    map<int, Json::Value> closed;
+    map<int, Json::Value> exported;
+
+    Json::CharReaderBuilder builder;
+    unique_ptr<Json::CharReader> reader(builder.newCharReader());
+
+    string line;
+    while (getline(stream, line)){
+        Json::Value event;
+        string errors;
+
+        if (line.empty() || !reader->parse(line.data(), line.data() + line.size(), &event, &errors) || !event.isObject())
+            continue;
+
+        string name = event["event"].asString();
+        Json::Value &data = event["data"];
+
+        if (name == "logoFound")
+            logos[data["id"].asInt()] = data;
+        else if (name == "segmentClosed")
+            closed[data["id"].asInt()] = data;
+        else if (name == "segmentExported")
+            exported[data["id"].asInt()] = data;
+    }
+
+    // segments are exported in order, but an analysis that crashed may have closed more of them
+    for (map<int, Json::Value>::iterator it = closed.begin(); it != closed.end(); it++)
+        if (!exported.count(it->first))
+            exported[it->first] = it->second;
+
+    for (map<int, Json::Value>::iterator it = logos.begin(); it != logos.end(); it++)
+        logoVec.append(it->second);
+
+    for (map<int, Json::Value>::iterator it = exported.begin(); it != exported.end(); it++)
+        segmentVec.append(it->second);
+
+    Json::Value json;
+    json["logos"] = logoVec;
+    json["segments"] = segmentVec;
+
+    return json;
+}
+
+bool camicasa::writeJsonFile(string path, const Json::Value &json)
+{
+    string temporary = path + ".tmp";
+
+    ofstream file;
+    file.open(temporary);
+
+    if (!file.is_open()){
+        puts("Error writing json file");
+        return false;
+    }
+
+    unique_ptr<Json::StreamWriter> writer(compactWriter());
+    writer->write(json, &file);
+    file << "\n";
+
+    file.close();
+
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
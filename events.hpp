@@ -0,0 +1,87 @@
+#ifndef _EVENTS_
+#define _EVENTS_
+
+#include <string>
+#include <fstream>
+#include <memory>
+#include <jsoncpp/json/json.h>
+#include "utils.hpp"
+
+using namespace std;
+
+namespace camicasa
+{
+
+    /**
+        @brief class camicasa::EventLog writing the events of an analysis as they happen, one compact json object per line
+        (NDJSON), so results survive a crash and can be read while the analysis runs
+        @note Each line is {"event": name, "timestamp": position in milliseconds, "data": object}, where the events are
+        segmentOpened, segmentRetyped, segmentClosed and segmentExported with a segment as data, adIdentified with the open
+        segment once its first seconds match a known ad (its adFound), and logoFound with a logo
+    */
+    class EventLog {
+    private:
+        /// @brief file receiving the events
+        ofstream file;
+        /// @brief writer of single line json
+        unique_ptr<Json::StreamWriter> writer;
+
+    public:
+        /**
+            @brief constructor of class camicasa::EventLog
+            @param path path of the file receiving the events
+            @param append optional flag to keep the events already in the file (default is false)
+        */
+        EventLog(string path, bool append = false);
+
+        /// @brief destructor of class camicasa::EventLog
+        ~EventLog();
+
+        /// @returns returns true if the file could be opened
+        bool isOpen();
+
+        /**
+            @brief The function camicasa::EventLog::write appends an event and flushes it to the file
+            @param event name of the event
+            @param timestamp position of the input in milliseconds when the event happened
+            @param data json object of the event
+        */
+        void write(string event, int timestamp, const Json::Value &data);
+    };
+
+    /**
+        @brief The function camicasa::segmentToJson converts a segment into its json.json representation
+        @param segment camicasa::Segment
+        @returns returns the json object of the segment
+    */
+    Json::Value segmentToJson(const Segment &segment);
+
+    /**
+        @brief The function camicasa::logoToJson converts a logo into its json.json representation
+        @param logo camicasa::Logo
+        @param analysisScale scale of the analysed frames, to report the logo in the coordinates of the input
+        @returns returns the json object of the logo
+    */
+    Json::Value logoToJson(const Logo &logo, double analysisScale);
+
+    /**
+        @brief The function camicasa::compactEvents rebuilds the json.json object from an event stream
+        @param stream stream of events written by a camicasa::EventLog
+        @returns returns the json object with the logos found and the segments, each one as exported or, if the analysis
+        did not get that far, as classified
+        @note Lines that cannot be parsed (e.g. the last one of a crashed analysis) are skipped
+    */
+    Json::Value compactEvents(istream &stream);
+
+    /**
+        @brief The function camicasa::writeJsonFile writes a json object as compact json, replacing the file at once so it 
+        can be read while the analysis runs
+        @param path path of the file
+        @param json json object to write
+        @returns returns true if the file was written
+    */
+    bool writeJsonFile(string path, const Json::Value &json);
+
+}
+
+#endif
@@ -0,0 +1,252 @@
+#include "frameindex.hpp"
+#include "streamcopy.hpp"
+#include "trace.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <algorithm>
+#include <sys/stat.h>
+
+using namespace camicasa;
+
+/// @brief header of the index file
+struct IndexHeader {
+    char magic[8];
+    int32_t version;
+    int32_t count;
+    int64_t sourceSize;
+    int64_t sourceTime;
+};
+
+/// @brief magic number of the index, with its version
+static const char indexMagic[8] = {'S', 'I', 'C', 'I', 'N', 'D', 'E', 'X'};
+static const int indexVersion = 1;
+
+/**
+    @brief Find the size and modification time of the input, which tell if an index still belongs to it
+    @param source path of the input
+    @param[out] header header receiving them
+    @returns returns false if the input could not be found
+*/
+static bool describeSource(string source, IndexHeader &header)
+{
+    struct stat info;
+
+    if (stat(source.c_str(), &info) != 0)
+        return false;
+
+    header.sourceSize = info.st_size;
+    header.sourceTime = info.st_mtime;
+    return true;
+}
+
+bool camicasa::FrameIndex::build(string source) {
+    this->entries.clear();
+
+    string command = "ffprobe -v error -select_streams v:0 -show_entries packet=pts_time,pos,flags -of csv=p=0 " + quoteArgument(source);
+
+    FILE *pipe = popen(command.c_str(), "r");
+    if (!pipe)
+        return false;
+
+    // packets come in decoding order with their presentation timestamps
+    vector<pair<double, pair<int64_t, bool>>> packets;
+
+    char line[256];
+    while (fgets(line, sizeof(line), pipe)){
+        // fields are pts_time,pos,flags and any of them may be N/A
+        char *pts = strtok(line, ",\r\n");
+        char *position = strtok(NULL, ",\r\n");
+        char *flags = strtok(NULL, ",\r\n");
+
+        if (pts == NULL || !strcmp(pts, "N/A"))
+            continue;
+
+        int64_t offset = (position != NULL && strcmp(position, "N/A")) ? atoll(position) : -1;
+
+        packets.push_back(make_pair(atof(pts), make_pair(offset, flags != NULL && flags[0] == 'K')));
+    }
+
+    if (pclose(pipe) != 0 || packets.empty())
+        return false;
+
+    sort(packets.begin(), packets.end());
+
+    double start = packets[0].first;
+    int keyframe = 0;
+
+    for (int i = 0; i < packets.size(); i++){
+        if (packets[i].second.second)
+            keyframe = i;
+
+        IndexEntry entry;
+        entry.pts = (int64_t)llround((packets[i].first - start) * 1000000);
+        entry.position = packets[i].second.first;
+        entry.keyframe = keyframe;
+
+        this->entries.push_back(entry);
+    }
+
+    return true;
+}
+
+bool camicasa::FrameIndex::load(string path, string source) {
+    IndexHeader expected;
+    if (!describeSource(source, expected))
+        return false;
+
+    ifstream file(path, ios::binary);
+    if (!file.is_open())
+        return false;
+
+    IndexHeader header;
+    file.read((char*)&header, sizeof(header));
+
+    if (!file || memcmp(header.magic, indexMagic, sizeof(indexMagic)) || header.version != indexVersion || header.count <= 0 ||
+        header.sourceSize != expected.sourceSize || header.sourceTime != expected.sourceTime)
+        return false;
+
+    this->entries.resize(header.count);
+    file.read((char*)this->entries.data(), header.count * sizeof(IndexEntry));
+
+    if (!file){
+        this->entries.clear();
+        return false;
+    }
+
+    return true;
+}
+
+bool camicasa::FrameIndex::save(string path, string source) {
+    IndexHeader header;
+    memcpy(header.magic, indexMagic, sizeof(indexMagic));
+    header.version = indexVersion;
+    header.count = this->entries.size();
+
+    if (!describeSource(source, header))
+        return false;
+
+    string temporary = path + ".tmp";
+
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file.is_open())
+        return false;
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)this->entries.data(), this->entries.size() * sizeof(IndexEntry));
+    file.close();
+
+    if (file.fail() || rename(temporary.c_str(), path.c_str()) != 0){
+        remove(temporary.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool camicasa::FrameIndex::empty() {
+    return this->entries.empty();
+}
+
+int camicasa::FrameIndex::size() {
+    return this->entries.size();
+}
+
+int camicasa::FrameIndex::frameAt(int timestamp) {
+    IndexEntry key;
+    key.pts = (int64_t)timestamp * 1000;
+
+    vector<IndexEntry>::iterator it = lower_bound(this->entries.begin(), this->entries.end(), key,
+        [](const IndexEntry &a, const IndexEntry &b) { return a.pts < b.pts; });
+
+    return it - this->entries.begin();
+}
+
+int camicasa::FrameIndex::timestampOf(int frame) {
+    if (this->entries.empty())
+        return 0;
+
+    frame = min(max(frame, 0), (int)this->entries.size() - 1);
+    return (int)(this->entries[frame].pts / 1000);
+}
+
+int64_t camicasa::FrameIndex::positionOf(int frame) {
+    if (frame < 0 || frame >= this->entries.size())
+        return -1;
+
+    return this->entries[frame].position;
+}
+
+int camicasa::FrameIndex::keyframeOf(int frame) {
+    if (this->entries.empty())
+        return 0;
+
+    frame = min(max(frame, 0), (int)this->entries.size() - 1);
+    return this->entries[frame].keyframe;
+}
+
+vector<int> camicasa::FrameIndex::getKeyframes() {
+    vector<int> keyframes;
+
+    for (int i = 0; i < this->entries.size(); i++)
+        if (this->entries[i].keyframe == i)
+            keyframes.push_back(i);
+
+    return keyframes;
+}
+
+vector<int> camicasa::FrameIndex::getKeyframeTimestamps() {
+    vector<int> keyframes = this->getKeyframes();
+
+    for (int i = 0; i < keyframes.size(); i++)
+        keyframes[i] = this->timestampOf(keyframes[i]);
+
+    return keyframes;
+}
+
+bool camicasa::FrameIndex::seek(VideoCapture &vidCapture, int frame) {
+    if (frame <= 0 || this->entries.empty())
+        return vidCapture.set(CAP_PROP_POS_FRAMES, max(frame, 0));
+
+    if (frame > this->entries.size())
+        return false;
+
+    // the frame before the wanted one is the last one skipped
+    int previous = frame - 1;
+    double target = this->entries[previous].pts / 1000.0;
+    // half the duration of the frame, to compare timestamps rounded by the backend
+    double tolerance = (previous > 0) ? (this->entries[previous].pts - this->entries[previous - 1].pts) / 2000.0 : 1;
+
+    // start from the keyframe, and from the one before it if the backend lands past the frame
+    for (int keyframe = this->entries[previous].keyframe; ; keyframe = this->entries[keyframe - 1].keyframe){
+        vidCapture.set(CAP_PROP_POS_MSEC, this->entries[keyframe].pts / 1000.0);
+
+        double timestamp = -1;
+        int skipped = 0;
+
+        while (timestamp < target - tolerance && skipped <= previous - keyframe + 1 && vidCapture.grab()){
+            timestamp = vidCapture.get(CAP_PROP_POS_MSEC);
+            skipped++;
+        }
+
+        if (timestamp >= target - tolerance && timestamp <= target + tolerance)
+            return true;
+
+        if (keyframe == 0 || timestamp < target - tolerance)
+            return false;
+    }
+}
+
+string camicasa::frameIndexPath(string source)
+{
+    return source + ".sicindex";
+}
+
+void camicasa::buildFrameIndex(string source, FrameIndex *index)
+{
+    nameTraceThread("indexer");
+    ScopedTrace trace("buildFrameIndex");
+
+    if (index->build(source) && !index->save(frameIndexPath(source), source))
+        puts("Error writing frame index");
+}
@@ -0,0 +1,127 @@
+#ifndef _FRAMEINDEX_
+#define _FRAMEINDEX_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief struct camicasa::IndexEntry describing a frame of the input, in presentation order
+    struct IndexEntry {
+        /// @brief presentation timestamp in microseconds from the first frame
+        int64_t pts;
+        /// @brief byte offset of the packet of the frame in the input (-1 if unknown)
+        int64_t position;
+        /// @brief number of the keyframe at or before the frame
+        int32_t keyframe;
+    };
+
+    /**
+        @brief class camicasa::FrameIndex mapping each frame number of the input to its presentation timestamp, byte offset and
+        nearest keyframe, kept on disk next to the input so reruns on the same file do not build it again
+        @note The index is built with ffprobe from the packets of the first video stream, without decoding them, and its 
+        timestamps start at the first frame as cv::CAP_PROP_POS_MSEC does
+    */
+    class FrameIndex {
+    private:
+        /// @brief frames of the input in presentation order
+        vector<IndexEntry> entries;
+
+    public:
+        /**
+            @brief The function camicasa::FrameIndex::build lists the frames of the input using ffprobe
+            @param source path of the input
+            @returns returns true if any frame was listed
+        */
+        bool build(string source);
+
+        /**
+            @brief The function camicasa::FrameIndex::load reads an index written by camicasa::FrameIndex::save
+            @param path path of the index
+            @param source path of the input, whose size and modification time must match the ones of the index
+            @returns returns true if the index was read
+        */
+        bool load(string path, string source);
+
+        /**
+            @brief The function camicasa::FrameIndex::save writes the index, replacing the file at once
+            @param path path of the index
+            @param source path of the input
+            @returns returns true if the index was written
+        */
+        bool save(string path, string source);
+
+        /// @returns returns true if the index has no frames
+        bool empty();
+
+        /// @returns returns the number of frames of the index
+        int size();
+
+        /**
+            @brief The function camicasa::FrameIndex::frameAt finds the first frame at or after a timestamp
+            @param timestamp position in milliseconds
+            @returns returns the frame number (size() if the timestamp is after the last frame)
+        */
+        int frameAt(int timestamp);
+
+        /**
+            @brief The function camicasa::FrameIndex::timestampOf finds the timestamp of a frame
+            @param frame frame number
+            @returns returns the position of the frame in milliseconds
+        */
+        int timestampOf(int frame);
+
+        /**
+            @brief The function camicasa::FrameIndex::positionOf finds where the packet of a frame is in the input
+            @param frame frame number
+            @returns returns the byte offset of the packet, -1 if unknown
+        */
+        int64_t positionOf(int frame);
+
+        /**
+            @brief The function camicasa::FrameIndex::keyframeOf finds the keyframe decoding must start from to reach a frame
+            @param frame frame number
+            @returns returns the frame number of the keyframe at or before it
+        */
+        int keyframeOf(int frame);
+
+        /// @returns returns the frame numbers of the keyframes, sorted
+        vector<int> getKeyframes();
+
+        /// @returns returns the timestamps of the keyframes in milliseconds, sorted
+        vector<int> getKeyframeTimestamps();
+
+        /**
+            @brief The function camicasa::FrameIndex::seek positions the input so that the next frame read is the given one,
+            seeking to its keyframe and skipping the frames up to it with cv::VideoCapture::grab by their timestamps
+            @param vidCapture opened cv::VideoCapture of the input
+            @param frame frame number
+            @returns returns false if the frame could not be reached
+        */
+        bool seek(VideoCapture &vidCapture, int frame);
+    };
+
+    /**
+        @brief The function camicasa::frameIndexPath finds where the index of an input is kept
+        @param source path of the input
+        @returns returns the path of the index, next to the input
+    */
+    string frameIndexPath(string source);
+
+    /**
+        @brief The function camicasa::buildFrameIndex builds the index of an input and saves it, to run on its own thread
+        while the input is analysed
+        @param source path of the input
+        @param index camicasa::FrameIndex receiving the frames
+    */
+    void buildFrameIndex(string source, FrameIndex *index);
+
+}
+
+#endif
@@ -0,0 +1,261 @@
+#include "library.hpp"
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+
+using namespace camicasa;
+
+/// @brief magic number of the index, with its version
+static const char libraryMagic[8] = {'S', 'I', 'C', 'L', 'O', 'G', 'O', 'S'};
+static const int libraryVersion = 1;
+
+camicasa::LogoLibrary::LogoLibrary(string directory) {
+    this->directory = directory;
+    this->mapping = NULL;
+    this->mappingSize = 0;
+
+    mkdir(directory.c_str(), 0777);
+}
+
+camicasa::LogoLibrary::~LogoLibrary() {
+    this->close();
+}
+
+void camicasa::LogoLibrary::close() {
+    if (this->mapping != NULL)
+        munmap(this->mapping, this->mappingSize);
+
+    this->mapping = NULL;
+    this->mappingSize = 0;
+}
+
+bool camicasa::LogoLibrary::isValid() {
+    const LibraryHeader *header = (const LibraryHeader*)this->mapping;
+
+    bool valid = this->mappingSize >= sizeof(LibraryHeader) && !memcmp(header->magic, libraryMagic, sizeof(libraryMagic)) &&
+                 header->version == libraryVersion && header->count >= 0 &&
+                 sizeof(LibraryHeader) + header->count * sizeof(LibraryRecord) <= this->mappingSize;
+
+    const LibraryRecord *records = (const LibraryRecord*)(header + 1);
+
+    for (int i = 0; valid && i < header->count; i++){
+        const LibraryRecord &record = records[i];
+
+        size_t imageSize = (size_t)record.imageRows * record.imageCols * CV_ELEM_SIZE(record.imageType);
+        size_t edgesSize = (size_t)record.edgesRows * record.edgesCols;
+
+        valid = record.imageOffset >= 0 && record.imageOffset + imageSize <= this->mappingSize &&
+                record.edgesOffset >= 0 && record.edgesOffset + edgesSize <= this->mappingSize;
+    }
+
+    if (!valid){
+        puts("Logo library index is not valid, ignored");
+        this->close();
+    }
+
+    return valid;
+}
+
+bool camicasa::LogoLibrary::open() {
+    this->close();
+
+    string path = this->directory + "/index.bin";
+
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(descriptor, &info) == 0 && info.st_size > 0){
+        void *mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, descriptor, 0);
+
+        if (mapping != MAP_FAILED){
+            this->mapping = mapping;
+            this->mappingSize = info.st_size;
+        }
+    }
+
+    // the mapping stays valid without the descriptor
+    ::close(descriptor);
+
+    return this->mapping != NULL && this->isValid();
+}
+
+vector<Logo> camicasa::LogoLibrary::findLogos(string channel, Size frameSize) {
+    vector<Logo> logos;
+
+    if (this->mapping == NULL)
+        return logos;
+
+    const LibraryHeader *header = (const LibraryHeader*)this->mapping;
+    const LibraryRecord *records = (const LibraryRecord*)(header + 1);
+    uchar *data = (uchar*)this->mapping;
+
+    for (int i = 0; i < header->count; i++){
+        const LibraryRecord &record = records[i];
+
+        if (strncmp(record.channel, channel.c_str(), sizeof(record.channel)) || record.frameWidth != frameSize.width ||
+            record.frameHeight != frameSize.height)
+            continue;
+
+        Logo logo;
+        logo.id = record.id;
+        logo.x = record.x;
+        logo.y = record.y;
+        logo.width = record.width;
+        logo.height = record.height;
+        logo.screenCorner = (ScreenCorner)record.screenCorner;
+        logo.image = Mat(record.imageRows, record.imageCols, record.imageType, data + record.imageOffset);
+        logo.edges = Mat(record.edgesRows, record.edgesCols, CV_8U, data + record.edgesOffset);
+
+        logos.push_back(logo);
+    }
+
+    return logos;
+}
+
+int camicasa::LogoLibrary::merge(string channel, Size frameSize, const vector<Logo> &logos, map<int, int> &identifiers) {
+    // runs merging at the same time take turns, each one reading the index left by the previous one
+    string lockPath = this->directory + "/index.lock";
+    int lock = ::open(lockPath.c_str(), O_CREAT | O_RDWR, 0666);
+    if (lock >= 0)
+        flock(lock, LOCK_EX);
+
+    int added = this->mergeLocked(channel, frameSize, logos, identifiers);
+
+    if (lock >= 0){
+        flock(lock, LOCK_UN);
+        ::close(lock);
+    }
+
+    return added;
+}
+
+int camicasa::LogoLibrary::mergeLocked(string channel, Size frameSize, const vector<Logo> &logos, map<int, int> &identifiers) {
+    identifiers.clear();
+    this->open();
+
+    // the records of the index, followed by the new ones
+    vector<LibraryRecord> records;
+    vector<Mat> images;
+    vector<Mat> edges;
+
+    if (this->mapping != NULL){
+        const LibraryHeader *header = (const LibraryHeader*)this->mapping;
+        const LibraryRecord *mapped = (const LibraryRecord*)(header + 1);
+        uchar *data = (uchar*)this->mapping;
+
+        for (int i = 0; i < header->count; i++){
+            records.push_back(mapped[i]);
+            images.push_back(Mat(mapped[i].imageRows, mapped[i].imageCols, mapped[i].imageType, data + mapped[i].imageOffset));
+            edges.push_back(Mat(mapped[i].edgesRows, mapped[i].edgesCols, CV_8U, data + mapped[i].edgesOffset));
+        }
+    }
+
+    vector<Logo> known = this->findLogos(channel, frameSize);
+    int nextId = 1;
+    for (int i = 0; i < known.size(); i++)
+        nextId = max(nextId, known[i].id + 1);
+
+    int added = 0;
+
+    for (int i = 0; i < logos.size(); i++){
+        const Logo &logo = logos[i];
+
+        if (logo.image.empty() || logo.edges.empty())
+            continue;
+
+        bool found = false;
+        for (int j = 0; j < known.size() && !found; j++){
+            found = isSameLogo(known[j], logo);
+
+            if (found)
+                identifiers[logo.id] = known[j].id;
+        }
+
+        if (found)
+            continue;
+
+        LibraryRecord record;
+        memset(&record, 0, sizeof(record));
+        strncpy(record.channel, channel.c_str(), sizeof(record.channel) - 1);
+        record.frameWidth = frameSize.width;
+        record.frameHeight = frameSize.height;
+        record.id = nextId++;
+        identifiers[logo.id] = record.id;
+        record.x = logo.x;
+        record.y = logo.y;
+        record.width = logo.width;
+        record.height = logo.height;
+        record.screenCorner = logo.screenCorner;
+        record.imageType = logo.image.type();
+        record.imageRows = logo.image.rows;
+        record.imageCols = logo.image.cols;
+        record.edgesRows = logo.edges.rows;
+        record.edgesCols = logo.edges.cols;
+
+        records.push_back(record);
+        // written as a single block of data
+        images.push_back(logo.image.isContinuous() ? logo.image : logo.image.clone());
+        edges.push_back(logo.edges.isContinuous() ? logo.edges : logo.edges.clone());
+        known.push_back(logo);
+        known.back().id = record.id;
+        added++;
+    }
+
+    if (added == 0)
+        return 0;
+
+    // the images follow the records, each one after the other
+    int64_t offset = sizeof(LibraryHeader) + records.size() * sizeof(LibraryRecord);
+    for (int i = 0; i < records.size(); i++){
+        records[i].imageOffset = offset;
+        offset += images[i].total() * images[i].elemSize();
+        records[i].edgesOffset = offset;
+        offset += edges[i].total();
+    }
+
+    LibraryHeader header;
+    memcpy(header.magic, libraryMagic, sizeof(libraryMagic));
+    header.version = libraryVersion;
+    header.count = records.size();
+
+    string path = this->directory + "/index.bin";
+    string temporary = path + ".tmp";
+
+    ofstream file(temporary, ios::binary | ios::trunc);
+    if (!file.is_open()){
+        puts("Error writing logo library");
+        identifiers.clear();
+        return -1;
+    }
+
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)records.data(), records.size() * sizeof(LibraryRecord));
+
+    for (int i = 0; i < records.size(); i++){
+        file.write((const char*)images[i].data, images[i].total() * images[i].elemSize());
+        file.write((const char*)edges[i].data, edges[i].total());
+    }
+
+    file.close();
+
+    if (file.fail() || rename(temporary.c_str(), path.c_str()) != 0){
+        puts("Error writing logo library");
+        identifiers.clear();
+        return -1;
+    }
+
+    // the images of the old index are no longer needed
+    images.clear();
+    edges.clear();
+    known.clear();
+    this->open();
+
+    return added;
+}
@@ -0,0 +1,110 @@
+#ifndef _LIBRARY_
+#define _LIBRARY_
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include "utils.hpp"
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief struct camicasa::LibraryHeader at the start of the index of a camicasa::LogoLibrary
+    struct LibraryHeader {
+        char magic[8];
+        int32_t version;
+        int32_t count;
+    };
+
+    /// @brief struct camicasa::LibraryRecord describing a logo of a camicasa::LogoLibrary, whose images follow the records
+    struct LibraryRecord {
+        char channel[64];
+        int32_t frameWidth;
+        int32_t frameHeight;
+        int32_t id;
+        int32_t x;
+        int32_t y;
+        int32_t width;
+        int32_t height;
+        int32_t screenCorner;
+        int32_t imageType;
+        int32_t imageRows;
+        int32_t imageCols;
+        int32_t edgesRows;
+        int32_t edgesCols;
+        int64_t imageOffset;
+        int64_t edgesOffset;
+    };
+
+    /**
+        @brief class camicasa::LogoLibrary keeping the logos found by every run on disk, keyed by channel and size of the analysed
+        frames, along with their edges so they match from the first frame
+        @note The index (directory/index.bin) is mapped in memory, and the logos found point to it until the library is closed or 
+        merged into
+    */
+    class LogoLibrary {
+    private:
+        /// @brief directory of the library
+        string directory;
+        /// @brief memory where the index is mapped, NULL if there is none
+        void *mapping;
+        /// @brief size of the mapped index in bytes
+        size_t mappingSize;
+
+        /// @brief method for unmapping the index
+        void close();
+
+        /// @brief method for checking the mapped index, unmapping it if it is not valid
+        bool isValid();
+
+        /// @brief method for merging logos while holding the lock of the library
+        int mergeLocked(string channel, Size frameSize, const vector<Logo> &logos, map<int, int> &identifiers);
+
+    public:
+        /**
+            @brief constructor of class camicasa::LogoLibrary
+            @param directory directory of the library, created if it does not exist
+        */
+        LogoLibrary(string directory);
+
+        /// @brief destructor of class camicasa::LogoLibrary
+        ~LogoLibrary();
+
+        /**
+            @brief The function camicasa::LogoLibrary::open maps the index of the library in memory
+            @returns returns true if the library has an index
+        */
+        bool open();
+
+        /**
+            @brief The function camicasa::LogoLibrary::findLogos lists the logos of a channel at a size of the analysed frames
+            @param channel name of the channel
+            @param frameSize size of the analysed frames
+            @returns returns the logos with their images and edges, pointing to the mapped index
+            @note See more in camicasa::TVChannel::addLogo()
+        */
+        vector<Logo> findLogos(string channel, Size frameSize);
+
+        /**
+            @brief The function camicasa::LogoLibrary::merge adds the logos of a channel that the library does not have yet,
+            replacing the index at once and mapping the new one
+            @param channel name of the channel
+            @param frameSize size of the analysed frames
+            @param logos camicasa::Logo found, with their edges computed
+            @param[out] identifiers identifier in the library of each logo, by its identifier in the run
+            @returns returns the number of logos added, -1 if the index could not be written
+            @note The index is mapped again, so logos found before no longer point to valid memory. Logos get new identifiers if
+            another run took theirs meanwhile, so they must be reported with the identifiers given back. See more in
+            camicasa::isSameLogo()
+        */
+        int merge(string channel, Size frameSize, const vector<Logo> &logos, map<int, int> &identifiers);
+    };
+
+}
+
+#endif
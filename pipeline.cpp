@@ -0,0 +1,308 @@
+#include "pipeline.hpp"
+#include "trace.hpp"
+#include <iostream>
+#include <unistd.h>
+
+using namespace camicasa;
+
+camicasa::SegmentEncoder::SegmentEncoder(string directory, int fps, Size frameSize, const VideoOptions &options) {
+    this->directory = directory;
+    this->fps = fps;
+    this->frameSize = frameSize;
+    this->options = options;
+}
+
+camicasa::SegmentEncoder::~SegmentEncoder() {
+    this->writer.release();
+}
+
+void camicasa::SegmentEncoder::execute(EncodeJob &job) {
+    ScopedTrace trace("encode");
+    trace.annotate(job.segmentId, NULL);
+
+    if (job.command == WRITE_FRAME){
+        if (this->writer.isOpened())
+            this->writer.write(job.frame);
+        return;
+    }
+
+    this->writer.release();
+
+    if (job.command != OPEN_SEGMENT)
+        return;
+
+    stringstream segmentWriter;
+    segmentWriter << this->directory << "/segment" << job.segmentId << ".mp4";
+
+    if (!openWriter(this->writer, segmentWriter.str(), this->fps, this->frameSize, this->options))
+        puts("Error opening video writer");
+}
+
+camicasa::FrameSpool::FrameSpool(string path, int memoryFrames) {
+    this->path = path;
+    this->memoryFrames = max(0, memoryFrames);
+    this->file = NULL;
+    this->fileFrames = 0;
+    this->fileDiscarded = 0;
+    this->spillType = -1;
+}
+
+camicasa::FrameSpool::~FrameSpool() {
+    this->clear();
+}
+
+bool camicasa::FrameSpool::push(const Mat &frame, int timestamp) {
+    // frames go to memory only while none is waiting on disk, so they stay in order
+    if (this->fileFrames == this->fileDiscarded && this->frames.size() < this->memoryFrames){
+        this->frames.push_back(frame.clone());
+        this->timestamps.push_back(timestamp);
+        return true;
+    }
+
+    if (this->file == NULL){
+        this->file = fopen(this->path.c_str(), "w+b");
+        this->spillSize = Size(frame.cols, frame.rows);
+        this->spillType = frame.type();
+    }
+
+    if (this->file == NULL || frame.cols != this->spillSize.width || frame.rows != this->spillSize.height || frame.type() != this->spillType)
+        return false;
+
+    // appended after the last frame, as the reads move the position
+    fseek(this->file, 0, SEEK_END);
+
+    Mat continuous = frame.isContinuous() ? frame : frame.clone();
+    if (fwrite(continuous.data, continuous.total() * continuous.elemSize(), 1, this->file) != 1)
+        return false;
+
+    this->fileFrames++;
+    this->timestamps.push_back(timestamp);
+    return true;
+}
+
+int camicasa::FrameSpool::size() {
+    return this->timestamps.size();
+}
+
+int camicasa::FrameSpool::timestampAt(int index) {
+    return this->timestamps[index];
+}
+
+void camicasa::FrameSpool::read(int index, Mat &frame) {
+    if (index < this->frames.size()){
+        frame = this->frames[index];
+        return;
+    }
+
+    // a new buffer for each frame read, as encoder threads may still hold the previous one
+    frame = Mat(this->spillSize, this->spillType);
+    size_t frameBytes = frame.total() * frame.elemSize();
+    long position = (long)(this->fileDiscarded + index - this->frames.size()) * frameBytes;
+
+    if (fseek(this->file, position, SEEK_SET) != 0 || fread(frame.data, frameBytes, 1, this->file) != 1)
+        frame = Mat();
+}
+
+void camicasa::FrameSpool::discardFront(int count) {
+    count = min(count, this->size());
+
+    for (int i = 0; i < count; i++){
+        if (!this->frames.empty())
+            this->frames.pop_front();
+        else
+            this->fileDiscarded++;
+
+        this->timestamps.pop_front();
+    }
+
+    if (this->timestamps.empty())
+        this->clear();
+}
+
+void camicasa::FrameSpool::clear() {
+    this->frames.clear();
+    this->timestamps.clear();
+    this->fileFrames = 0;
+    this->fileDiscarded = 0;
+
+    if (this->file != NULL){
+        fclose(this->file);
+        remove(this->path.c_str());
+        this->file = NULL;
+    }
+}
+
+Size camicasa::analysisSize(Size frameSize, double scale) {
+    if (scale <= 0)
+        return frameSize;
+
+    return Size(max(1, (int)round(frameSize.width * scale)), max(1, (int)round(frameSize.height * scale)));
+}
+
+void camicasa::prepareAnalysisFrame(Mat &frame, Mat &analysisFrame, double scale) {
+    if (scale <= 0 || frame.empty()){
+        analysisFrame = frame;
+        return;
+    }
+
+    Size size = analysisSize(Size(frame.cols, frame.rows), scale);
+
+    if (size.width == frame.cols && size.height == frame.rows){
+        if (frame.channels() == 3)
+            cvtColor(frame, analysisFrame, COLOR_BGR2GRAY);
+        else
+            analysisFrame = frame;
+        return;
+    }
+
+    // reused by each thread between frames
+    static thread_local Mat gray;
+
+    if (frame.channels() == 3){
+        cvtColor(frame, gray, COLOR_BGR2GRAY);
+        resize(gray, analysisFrame, size, 0, 0, INTER_AREA);
+    }
+    else
+        resize(frame, analysisFrame, size, 0, 0, INTER_AREA);
+}
+
+bool camicasa::readFrame(VideoCapture &vidCapture, DecodedFrame &decoded, double analysisScale) {
+    ScopedTrace trace("decode");
+
+    if (!vidCapture.isOpened()){
+        decoded.frame = Mat();
+        return false;
+    }
+
+    // Mat::create writes into the buffers of the previous frame whenever the size and type match, even if other Mats still
+    // share them, so callers must clone what they keep or give the decoded frame new headers (see camicasa::decodeFrames)
+    vidCapture >> decoded.frame;
+    if (decoded.frame.empty())
+        return false;
+
+    decoded.timestamp = vidCapture.get(CAP_PROP_POS_MSEC);
+    decoded.frameNumber = vidCapture.get(CAP_PROP_POS_FRAMES);
+    decoded.black = -1;
+
+    prepareAnalysisFrame(decoded.frame, decoded.analysisFrame, analysisScale);
+    return true;
+}
+
+/**
+    @brief Open an input with the given backend, with the parameters of the options and then without them
+    @param vidCapture cv::VideoCapture to open
+    @param source path or URL of the input, or a number for a camera
+    @param camera true if the source is the number of a camera
+    @param backend cv::VideoCaptureAPIs to open it with
+    @param parameters pairs of cv::VideoCaptureProperties and values
+    @returns returns true if the input was opened
+*/
+static bool openWithParameters(VideoCapture &vidCapture, string source, bool camera, int backend, const vector<int> &parameters)
+{
+    if (!parameters.empty()){
+        bool opened = camera ? vidCapture.open(atoi(source.c_str()), backend, parameters) : vidCapture.open(source, backend, parameters);
+        if (opened)
+            return true;
+    }
+
+    bool opened = camera ? vidCapture.open(atoi(source.c_str()), backend) : vidCapture.open(source, backend);
+
+    // the decoder threads and capture properties asked for are not applied
+    if (opened && !parameters.empty())
+        cout << "Warning: input opened by " << vidCapture.getBackendName() << " without its capture parameters\n";
+
+    return opened;
+}
+
+bool camicasa::openInput(VideoCapture &vidCapture, string source, const VideoOptions &options) {
+    // a recording may be named by a number (e.g. 20240501), so only a number that is no file is a camera
+    bool camera = !source.empty() && source.find_first_not_of("0123456789") == string::npos && access(source.c_str(), F_OK) != 0;
+
+    vector<int> parameters;
+    if (options.decoderThreads > 0){
+        parameters.push_back(CAP_PROP_N_THREADS);
+        parameters.push_back(options.decoderThreads);
+    }
+    parameters.insert(parameters.end(), options.captureParameters.begin(), options.captureParameters.end());
+
+    // pipes and network streams are read by FFmpeg
+    if (source == "-")
+        source = "pipe:0";
+
+    bool opened = false;
+
+    if (options.backend != CAP_ANY)
+        opened = openWithParameters(vidCapture, source, camera, options.backend, parameters);
+    else if (camera)
+        opened = openWithParameters(vidCapture, source, camera, CAP_ANY, parameters);
+    else
+        opened = openWithParameters(vidCapture, source, camera, CAP_FFMPEG, parameters) || openWithParameters(vidCapture, source, camera, CAP_ANY, parameters);
+
+    if (opened && options.bufferSize > 0)
+        vidCapture.set(CAP_PROP_BUFFERSIZE, options.bufferSize);
+
+    // backends may take the parameters and still ignore the number of threads
+    if (opened && options.decoderThreads > 0 && (int)vidCapture.get(CAP_PROP_N_THREADS) != options.decoderThreads)
+        cout << "Warning: " << options.decoderThreads << " decoder threads asked for, " << vidCapture.getBackendName() << " uses "
+             << (int)vidCapture.get(CAP_PROP_N_THREADS) << "\n";
+
+    return opened;
+}
+
+bool camicasa::openWriter(VideoWriter &writer, string path, int fps, Size frameSize, const VideoOptions &options) {
+    int fourcc = VideoWriter::fourcc('a', 'v', 'c', '1');
+
+    if (!options.writerParameters.empty() && writer.open(path, options.writerBackend, fourcc, fps, frameSize, options.writerParameters))
+        return true;
+
+    return writer.open(path, options.writerBackend, fourcc, fps, frameSize, vector<int>());
+}
+
+int camicasa::parseBackend(string name) {
+    if (name == "any")
+        return CAP_ANY;
+    if (name == "ffmpeg")
+        return CAP_FFMPEG;
+    if (name == "gstreamer")
+        return CAP_GSTREAMER;
+    if (name == "v4l2")
+        return CAP_V4L2;
+
+    return -1;
+}
+
+void camicasa::decodeFrames(VideoCapture *vidCapture, BoundedQueue<DecodedFrame> *queue, double analysisScale, atomic<bool> *stop) {
+    DecodedFrame decoded;
+    nameTraceThread("decoder");
+
+    // the decoder thread also prepares the frames to analyse
+    while ((stop == NULL || !*stop) && readFrame(*vidCapture, decoded, analysisScale)){
+        queue->push(decoded);
+
+        // the queue holds the buffers now, the next frame needs new ones
+        decoded.frame = Mat();
+        decoded.analysisFrame = Mat();
+    }
+
+    // the empty frame tells the consumer the input ended
+    decoded.frame = Mat();
+    queue->push(decoded);
+}
+
+void camicasa::encodeSegments(BoundedQueue<EncodeJob> *queue, SegmentEncoder *encoder) {
+    EncodeJob job;
+    nameTraceThread("encoder");
+
+    while (true){
+        queue->pop(job);
+
+        if (job.command == STOP_ENCODING)
+            break;
+
+        encoder->execute(job);
+    }
+
+    EncodeJob close;
+    close.command = CLOSE_SEGMENT;
+    encoder->execute(close);
+}
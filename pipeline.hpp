@@ -0,0 +1,352 @@
+#ifndef _PIPELINE_
+#define _PIPELINE_
+
+#include <opencv2/opencv.hpp>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <deque>
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief enum camicasa::EncodeCommand used for defining what an encoder does with a camicasa::EncodeJob
+    enum EncodeCommand {OPEN_SEGMENT, WRITE_FRAME, CLOSE_SEGMENT, STOP_ENCODING};
+
+    /// @brief struct camicasa::DecodedFrame containing a frame, the frame to analyse and its position in the input
+    struct DecodedFrame {
+        Mat frame;
+        Mat analysisFrame;
+        int timestamp = 0;
+        int frameNumber = 0;
+        /// @brief 1 if the frame to analyse was already found black, 0 if not, -1 if it was not checked
+        int black = -1;
+    };
+
+    /// @brief struct camicasa::VideoOptions with how inputs are decoded and segments encoded, given to every cv::VideoCapture and cv::VideoWriter opened
+    struct VideoOptions {
+        /// @brief backend of the inputs (cv::VideoCaptureAPIs), CAP_ANY to try FFmpeg first and then the others
+        int backend = CAP_ANY;
+        /// @brief backend of the written segments (cv::VideoCaptureAPIs), CAP_ANY to let OpenCV choose
+        int writerBackend = CAP_ANY;
+        /// @brief number of decoder threads of each input, 0 to let the backend choose
+        int decoderThreads = 0;
+        /// @brief number of frames buffered by the backend of each input, 0 to let the backend choose
+        int bufferSize = 0;
+        /// @brief other parameters given when opening an input, pairs of cv::VideoCaptureProperties and values
+        vector<int> captureParameters;
+        /// @brief parameters given when opening a written segment, pairs of cv::VideoWriterProperties and values
+        vector<int> writerParameters;
+    };
+
+    /// @brief struct camicasa::EncodeJob containing an operation over the video file of a segment
+    struct EncodeJob {
+        EncodeCommand command = WRITE_FRAME;
+        int segmentId = -1;
+        Mat frame;
+    };
+
+    /**
+        @brief class camicasa::BoundedQueue is a lock-free ring buffer with a single producer and a single consumer
+        @note push and pop wait while the queue is full or empty, so memory is bounded by the capacity. They retry briefly and then
+        sleep until the other side pops or pushes, so a thread waiting on a slow encoder or decoder does not take a core
+    */
+    template <typename T>
+    class BoundedQueue {
+    private:
+        /// @brief slots of the ring buffer, one more than the capacity to tell full from empty
+        vector<T> buffer;
+        /// @brief index of the next slot to pop, only written by the consumer
+        atomic<size_t> head;
+        /// @brief index of the next slot to push, only written by the producer
+        atomic<size_t> tail;
+        /// @brief true while the producer or the consumer sleeps, so the other side only takes the mutex to wake it up
+        atomic<bool> producerWaiting;
+        atomic<bool> consumerWaiting;
+        mutex waitMutex;
+        condition_variable notFull;
+        condition_variable notEmpty;
+
+        /// @brief number of retries before sleeping
+        static const int spinCount = 64;
+
+        /// @brief method for waking up the other side if it sleeps, after pushing or popping
+        void wake(atomic<bool> &waiting, condition_variable &condition) {
+            // the index written is seen by the sleeper, or the sleeper is seen by the waker
+            atomic_thread_fence(memory_order_seq_cst);
+
+            if (waiting.load(memory_order_relaxed)){
+                // taken so the notification cannot fall between the check and the wait of the sleeper
+                { lock_guard<mutex> lock(this->waitMutex); }
+                condition.notify_one();
+            }
+        }
+
+    public:
+        /**
+            @brief constructor of class camicasa::BoundedQueue
+            @param capacity maximum number of items held at once
+        */
+        BoundedQueue(int capacity) {
+            this->buffer.resize(capacity + 1);
+            this->head = 0;
+            this->tail = 0;
+            this->producerWaiting = false;
+            this->consumerWaiting = false;
+        }
+
+        /// @returns returns true if the item was pushed, false if the queue is full
+        bool tryPush(T &item) {
+            size_t tail = this->tail.load(memory_order_relaxed);
+            size_t next = (tail + 1) % this->buffer.size();
+
+            if (next == this->head.load(memory_order_acquire))
+                return false;
+
+            this->buffer[tail] = item;
+            this->tail.store(next, memory_order_release);
+            return true;
+        }
+
+        /// @returns returns true if an item was popped, false if the queue is empty
+        bool tryPop(T &item) {
+            size_t head = this->head.load(memory_order_relaxed);
+
+            if (head == this->tail.load(memory_order_acquire))
+                return false;
+
+            item = this->buffer[head];
+            // release what the slot holds (e.g. cv::Mat data) as soon as possible
+            this->buffer[head] = T();
+            this->head.store((head + 1) % this->buffer.size(), memory_order_release);
+            return true;
+        }
+
+        /// @brief pushes the item, waiting while the queue is full
+        void push(T &item) {
+            bool pushed = false;
+
+            for (int i = 0; i < spinCount && !pushed; i++)
+                pushed = this->tryPush(item);
+
+            if (!pushed){
+                unique_lock<mutex> lock(this->waitMutex);
+                this->producerWaiting.store(true, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+
+                while (!this->tryPush(item))
+                    this->notFull.wait(lock);
+
+                this->producerWaiting.store(false, memory_order_relaxed);
+            }
+
+            this->wake(this->consumerWaiting, this->notEmpty);
+        }
+
+        /// @brief pops an item, waiting while the queue is empty
+        void pop(T &item) {
+            bool popped = false;
+
+            for (int i = 0; i < spinCount && !popped; i++)
+                popped = this->tryPop(item);
+
+            if (!popped){
+                unique_lock<mutex> lock(this->waitMutex);
+                this->consumerWaiting.store(true, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+
+                while (!this->tryPop(item))
+                    this->notEmpty.wait(lock);
+
+                this->consumerWaiting.store(false, memory_order_relaxed);
+            }
+
+            this->wake(this->producerWaiting, this->notFull);
+        }
+    };
+
+    /// @brief class camicasa::SegmentEncoder writing the video files of segments as told by camicasa::EncodeJob
+    class SegmentEncoder {
+    private:
+        /// @brief directory where the segments are written
+        string directory;
+        /// @brief number of frames per second of the written videos
+        int fps;
+        /// @brief size of the written frames
+        Size frameSize;
+        /// @brief writer of the open segment
+        VideoWriter writer;
+        /// @brief how the segments are encoded
+        VideoOptions options;
+
+    public:
+        /**
+            @brief constructor of class camicasa::SegmentEncoder
+            @param directory directory where the segments are written
+            @param fps number of frames per second of the written videos
+            @param frameSize size of the written frames
+            @param options optional camicasa::VideoOptions with the backend and parameters of the writers (default is none)
+        */
+        SegmentEncoder(string directory, int fps, Size frameSize, const VideoOptions &options = VideoOptions());
+
+        /// @brief destructor of class camicasa::SegmentEncoder
+        ~SegmentEncoder();
+
+        /**
+            @brief The function camicasa::SegmentEncoder::execute runs the given job, opening (or truncating) directory/segmentN.mp4,
+            writing a frame to it or closing it
+            @param job camicasa::EncodeJob to run
+        */
+        void execute(EncodeJob &job);
+    };
+
+    /**
+        @brief class camicasa::FrameSpool holding frames in order, the first ones in memory and the rest in a file on disk
+        @note The frames spilled to disk are written raw, so they must all have the size and type of the first one spilled
+    */
+    class FrameSpool {
+    private:
+        /// @brief path of the file receiving the frames that do not fit in memory
+        string path;
+        /// @brief maximum number of frames held in memory
+        int memoryFrames;
+        /// @brief oldest frames held, kept in memory
+        deque<Mat> frames;
+        /// @brief timestamps of the frames held
+        deque<int> timestamps;
+        /// @brief file of the frames spilled to disk, NULL if none was spilled
+        FILE *file;
+        /// @brief number of frames written to the file
+        int fileFrames;
+        /// @brief number of frames of the file already discarded
+        int fileDiscarded;
+        /// @brief size and type of the frames spilled to disk
+        Size spillSize;
+        int spillType;
+
+    public:
+        /**
+            @brief constructor of class camicasa::FrameSpool
+            @param path path of the file receiving the frames that do not fit in memory
+            @param memoryFrames maximum number of frames held in memory
+        */
+        FrameSpool(string path, int memoryFrames);
+
+        /// @brief destructor of class camicasa::FrameSpool, removing the file
+        ~FrameSpool();
+
+        /**
+            @brief The function camicasa::FrameSpool::push holds a copy of the frame after the others
+            @param frame image frame input cv::Mat
+            @param timestamp position of the frame in milliseconds
+            @returns returns false if the frame could not be written to disk
+        */
+        bool push(const Mat &frame, int timestamp);
+
+        /// @returns returns the number of frames held
+        int size();
+
+        /// @returns returns the timestamp of the frame at the given index
+        int timestampAt(int index);
+
+        /**
+            @brief The function camicasa::FrameSpool::read gets a frame held
+            @param index index of the frame, 0 for the oldest one held
+            @param[out] frame frame read, sharing the memory of the spool if it was held in memory
+        */
+        void read(int index, Mat &frame);
+
+        /**
+            @brief The function camicasa::FrameSpool::discardFront stops holding the oldest frames
+            @param count number of frames discarded
+            @note The file keeps its size until every frame is discarded
+        */
+        void discardFront(int count);
+
+        /// @brief method for discarding every frame held, removing the file
+        void clear();
+    };
+
+    /**
+        @brief The function camicasa::analysisSize finds the size of the frames analysed at the given scale
+        @param frameSize size of the frames of the input
+        @param scale scale of the analysed frames, 0 to analyse the frames of the input
+        @returns returns the scaled size
+    */
+    Size analysisSize(Size frameSize, double scale);
+
+    /**
+        @brief The function camicasa::prepareAnalysisFrame converts a frame of the input into the frame analysed, in grayscale
+        and scaled down, which is all the black frame and logo detections need
+        @param[in] frame image frame input cv::Mat
+        @param[out] analysisFrame image frame output cv::Mat, sharing the input if the scale is 0
+        @param scale scale of the analysed frames, 0 to analyse the frames of the input
+    */
+    void prepareAnalysisFrame(Mat &frame, Mat &analysisFrame, double scale);
+
+    /**
+        @brief The function camicasa::readFrame reads the next frame of the input with its position
+        @param vidCapture opened cv::VideoCapture of the input
+        @param[out] decoded camicasa::DecodedFrame read, with an empty frame when the input ends
+        @note The buffers of the given camicasa::DecodedFrame are overwritten whatever other cv::Mat share them, so frames
+        kept elsewhere must be cloned, or released from it before the next read
+        @param analysisScale optional scale of the analysed frames, 0 to analyse the frames of the input (default is 0)
+        @returns returns false when the input ends
+    */
+    bool readFrame(VideoCapture &vidCapture, DecodedFrame &decoded, double analysisScale = 0);
+
+    /**
+        @brief The function camicasa::openInput opens a file, a camera, a pipe or a network stream
+        @param vidCapture cv::VideoCapture to open
+        @param source path or URL of the input (e.g. udp://@:1234), a number for a camera (unless a file has that name) or "-"
+        for the standard input
+        @param options optional camicasa::VideoOptions with the backend, decoder threads and parameters (default is none)
+        @returns returns true if the input was opened
+        @note Parameters the backend does not support make it fail to open, so the input is opened again without them
+    */
+    bool openInput(VideoCapture &vidCapture, string source, const VideoOptions &options = VideoOptions());
+
+    /**
+        @brief The function camicasa::openWriter opens a video file to write H.264 frames to
+        @param writer cv::VideoWriter to open
+        @param path path of the written video
+        @param fps number of frames per second of the video
+        @param frameSize size of the written frames
+        @param options optional camicasa::VideoOptions with the backend and parameters of the writer (default is none)
+        @returns returns true if the writer was opened
+    */
+    bool openWriter(VideoWriter &writer, string path, int fps, Size frameSize, const VideoOptions &options = VideoOptions());
+
+    /**
+        @brief The function camicasa::parseBackend finds the backend of OpenCV with the given name
+        @param name any, ffmpeg, gstreamer or v4l2
+        @returns returns the cv::VideoCaptureAPIs, -1 if the name is unknown
+    */
+    int parseBackend(string name);
+
+    /**
+        @brief The function camicasa::decodeFrames reads every frame of the input into the queue, ending with an empty frame
+        @param vidCapture opened cv::VideoCapture of the input
+        @param queue camicasa::BoundedQueue receiving the frames
+        @param analysisScale scale of the analysed frames, 0 to analyse the frames of the input
+        @param stop optional flag to stop reading before the input ends, for inputs that never do (default is NULL)
+    */
+    void decodeFrames(VideoCapture *vidCapture, BoundedQueue<DecodedFrame> *queue, double analysisScale, atomic<bool> *stop = NULL);
+
+    /**
+        @brief The function camicasa::encodeSegments runs the jobs of the queue until a STOP_ENCODING job arrives
+        @param queue camicasa::BoundedQueue with the jobs
+        @param encoder camicasa::SegmentEncoder running the jobs
+    */
+    void encodeSegments(BoundedQueue<EncodeJob> *queue, SegmentEncoder *encoder);
+
+}
+
+#endif
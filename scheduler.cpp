@@ -0,0 +1,95 @@
+#include "scheduler.hpp"
+#include "trace.hpp"
+
+using namespace camicasa;
+
+camicasa::FrameScheduler::FrameScheduler(TVChannel *channel, int fps, int maximumStep) {
+    this->channel = channel;
+    this->fps = max(1, fps);
+    this->maximumStep = max(1, maximumStep);
+    this->step = 1;
+    this->lastAnalysed = -1;
+    this->previousBlack = false;
+    this->previousLogo = false;
+    // the first segment opens near the start
+    this->denseFrames = this->fps;
+    this->analysedFrames = 0;
+    this->skippedFrames = 0;
+    this->rewinds = 0;
+}
+
+bool camicasa::FrameScheduler::read(VideoCapture &vidCapture, DecodedFrame &decoded, double analysisScale) {
+    // the logo was missed on the last analysed frame, the frames around the end of the segment are analysed one by one
+    bool logo = this->channel->isLogoFound();
+    if (this->previousLogo && !logo){
+        this->denseFrames = max(this->denseFrames, this->fps);
+        this->step = 1;
+    }
+    this->previousLogo = logo;
+
+    while (true){
+        int position = vidCapture.get(CAP_PROP_POS_FRAMES);
+
+        if (this->lastAnalysed < 0)
+            this->lastAnalysed = position;
+
+        // the position after reading the frame, as given to camicasa::TVChannel::processFrame
+        int frameNumber = position + 1;
+
+        bool analyse = this->denseFrames > 0 || frameNumber % this->fps == 0 || frameNumber - this->lastAnalysed >= this->step;
+
+        if (!analyse){
+            ScopedTrace trace("skipFrame");
+
+            if (!vidCapture.grab()){
+                decoded.frame = Mat();
+                return false;
+            }
+
+            this->skippedFrames++;
+            continue;
+        }
+
+        if (!readFrame(vidCapture, decoded, analysisScale))
+            return false;
+
+        bool black = this->channel->isBlackFrame(decoded.analysisFrame);
+        decoded.black = black;
+
+        // the segment closed somewhere among the skipped frames, which are read again one by one
+        if (black && !this->previousBlack && decoded.frameNumber - this->lastAnalysed > 1 && this->denseFrames == 0 &&
+            vidCapture.set(CAP_PROP_POS_FRAMES, this->lastAnalysed)){
+            this->skippedFrames -= decoded.frameNumber - this->lastAnalysed - 1;
+            this->denseFrames = decoded.frameNumber - this->lastAnalysed + this->fps;
+            this->rewinds++;
+            continue;
+        }
+
+        if (black){
+            this->denseFrames = this->fps;
+            this->step = 1;
+        }
+        else if (this->denseFrames > 0)
+            this->denseFrames--;
+        else
+            this->step = min(this->maximumStep, 2 * this->step);
+
+        this->previousBlack = black;
+        this->lastAnalysed = decoded.frameNumber;
+        this->analysedFrames++;
+
+        return true;
+    }
+}
+
+long long camicasa::FrameScheduler::getAnalysedFrames() {
+    return this->analysedFrames;
+}
+
+long long camicasa::FrameScheduler::getSkippedFrames() {
+    return this->skippedFrames;
+}
+
+long long camicasa::FrameScheduler::getRewinds() {
+    return this->rewinds;
+}
@@ -0,0 +1,80 @@
+#ifndef _SCHEDULER_
+#define _SCHEDULER_
+
+#include <opencv2/opencv.hpp>
+#include "utils.hpp"
+#include "pipeline.hpp"
+
+using namespace cv;
+using namespace std;
+
+namespace camicasa
+{
+
+    /**
+        @brief class camicasa::FrameScheduler reading only the frames of a file the classification needs, skipping the others
+        with cv::VideoCapture::grab (decoded but not converted nor analysed)
+        @note While a segment is stable, frames are analysed every few frames (the step doubles up to a maximum) and always on 
+        the frames searched for new logos (frameNumber % fps == 0). A black frame found after skipped frames makes the scheduler
+        seek back and analyse them one by one, so segments close and open on the same frames as reading all of them, and the 
+        frames stay analysed one by one while black and for a second after. The same happens for a second after the logo of
+        the open segment is missed, as the segment is about to close. Black runs shorter than the maximum step may go 
+        unnoticed, and known logos are looked for only on the frames analysed. Whether a frame is black is told to
+        camicasa::TVChannel::processFrame through camicasa::DecodedFrame::black, so it is checked once
+    */
+    class FrameScheduler {
+    private:
+        /// @brief channel deciding which frames are black
+        TVChannel *channel;
+        /// @brief number of frames per second of the input
+        int fps;
+        /// @brief maximum number of frames between analysed frames
+        int maximumStep;
+        /// @brief current number of frames between analysed frames
+        int step;
+        /// @brief position of the input after the last analysed frame (-1 before the first one)
+        int lastAnalysed;
+        /// @brief true if the last analysed frame was black
+        bool previousBlack;
+        /// @brief true if the logo of the open segment was on screen after the last analysed frame
+        bool previousLogo;
+        /// @brief number of frames still analysed one by one
+        int denseFrames;
+        /// @brief number of frames analysed
+        long long analysedFrames;
+        /// @brief number of frames skipped
+        long long skippedFrames;
+        /// @brief number of times the input was read again from the last analysed frame
+        long long rewinds;
+
+    public:
+        /**
+            @brief constructor of class camicasa::FrameScheduler
+            @param channel camicasa::TVChannel analysing the frames, with its settings
+            @param fps number of frames per second of the input
+            @param maximumStep maximum number of frames between analysed frames, 1 to analyse all of them
+        */
+        FrameScheduler(TVChannel *channel, int fps, int maximumStep);
+
+        /**
+            @brief The function camicasa::FrameScheduler::read reads the next frame to analyse, as camicasa::readFrame does
+            @param vidCapture opened cv::VideoCapture of a file (it must be able to seek)
+            @param[out] decoded camicasa::DecodedFrame read, with an empty frame when the input ends
+            @param analysisScale scale of the analysed frames, 0 to analyse the frames of the input
+            @returns returns false when the input ends
+        */
+        bool read(VideoCapture &vidCapture, DecodedFrame &decoded, double analysisScale);
+
+        /// @returns returns the number of frames analysed
+        long long getAnalysedFrames();
+
+        /// @returns returns the number of frames skipped
+        long long getSkippedFrames();
+
+        /// @returns returns the number of times the input was read again
+        long long getRewinds();
+    };
+
+}
+
+#endif
@@ -3,363 +3,1313 @@
 #include <bits/stdc++.h>
 #include <sys/stat.h>
 #include <sys/types.h>
-#include "utils.hpp" 
+#include <unistd.h>
+#include <dirent.h>
+#include "utils.hpp"
+#include "pipeline.hpp"
+#include "chunks.hpp"
+#include "streamcopy.hpp"
+#include "events.hpp"
+#include "library.hpp"
+#include "adindex.hpp"
+#include "scheduler.hpp"
+#include "frameindex.hpp"
+#include "trace.hpp"
 #include <jsoncpp/json/json.h>
 #include <fstream>
+#include <csignal>
 
 using namespace std;
 using namespace cv;
 using namespace camicasa;
 
 
-int main(int argc, char** argv)
+/// @brief set when the analysis of a live input has to stop
+atomic<bool> stopRequested(false);
+
+/// @brief Signal handler stopping a live analysis, so the open segment is still closed and reported
+void requestStop(int signal)
+{
+    stopRequested = true;
+}
+
+/**
+    @brief Find the path of a file in the output directory of an input
+    @param directory output directory of the input (empty for the working directory)
+    @param name name of the file
+    @returns returns directory/name, or the name if there is no directory
+*/
+string outputPath(string directory, string name)
+{
+    if (directory.empty())
+        return name;
+
+    return directory + "/" + name;
+}
+
+/**
+    @brief Write the logos and segments found in json.json
+    @param logoVec json array of logos
+    @param segmentVec json array of segments
+    @param directory output directory of the input (empty for the working directory)
+    @note See more in camicasa::writeJsonFile()
+*/
+void writeJson(Json::Value &logoVec, Json::Value &segmentVec, string directory)
+{
+    Json::Value json;
+    json["logos"] = logoVec;
+    json["segments"] = segmentVec;
+
+    writeJsonFile(outputPath(directory, "json.json"), json);
+}
+
+/**
+    @brief Write the logo image to disk and append its information to the json array
+    @param logo camicasa::Logo found
+    @param logoVec json array of logos
+    @param analysisScale scale of the analysed frames, to report the logo in the coordinates of the input
+    @param events camicasa::EventLog receiving a logoFound event
+    @param timestamp position of the input in milliseconds when the logo was found
+    @param directory output directory of the input (empty for the working directory)
+*/
+void reportLogo(const Logo &logo, Json::Value &logoVec, double analysisScale, EventLog &events, int timestamp, string directory)
+{
+    stringstream logoWriter;
+    logoWriter << outputPath(directory, "logos") << "/logo" << logo.id << ".jpg";
+    imwrite(logoWriter.str(), logo.image);
+
+    Json::Value logoJson = logoToJson(logo, analysisScale);
+
+    logoVec.append(logoJson);
+    events.write("logoFound", timestamp, logoJson);
+}
+
+/**
+    @brief Report the logos with the identifiers the library gave them, renaming their images
+    @param identifiers identifier in the library of each logo, by its identifier in the run
+    @param logoVec json array of logos
+    @param segmentVec json array of segments
+    @param directory output directory of the input (empty for the working directory)
+    @note events.ndjson keeps the identifiers of the run, as it was written as the logos were found
+*/
+void renumberLogos(const map<int, int> &identifiers, Json::Value &logoVec, Json::Value &segmentVec, string directory)
+{
+    vector<pair<string, string>> renames;
+
+    for (int i = 0; i < logoVec.size(); i++){
+        map<int, int>::const_iterator it = identifiers.find(logoVec[i]["id"].asInt());
+        if (it == identifiers.end() || it->first == it->second)
+            continue;
+
+        stringstream from, to;
+        from << outputPath(directory, "logos") << "/logo" << it->first << ".jpg";
+        to << outputPath(directory, "logos") << "/logo" << it->second << ".jpg";
+        renames.push_back(make_pair(from.str(), to.str()));
+
+        logoVec[i]["id"] = it->second;
+    }
+
+    // through temporary names, as a logo may take the identifier another one leaves
+    for (int i = 0; i < renames.size(); i++)
+        rename(renames[i].first.c_str(), (renames[i].second + ".tmp").c_str());
+
+    for (int i = 0; i < renames.size(); i++)
+        rename((renames[i].second + ".tmp").c_str(), renames[i].second.c_str());
+
+    // logos the library already had under another identifier are reported once
+    Json::Value logos(Json::arrayValue);
+    set<int> reported;
+
+    for (int i = 0; i < logoVec.size(); i++)
+        if (reported.insert(logoVec[i]["id"].asInt()).second)
+            logos.append(logoVec[i]);
+
+    logoVec = logos;
+
+    for (int i = 0; i < segmentVec.size(); i++){
+        map<int, int>::const_iterator it = identifiers.find(segmentVec[i]["logoFound"].asInt());
+        if (it != identifiers.end())
+            segmentVec[i]["logoFound"] = it->second;
+    }
+}
+
+/**
+    @brief Report the ads with the identifiers the ad index gave them
+    @param identifiers identifier in the ad index of each ad, by the one it had during the run
+    @param segmentVec json array of segments
+*/
+void renumberAds(const map<int, int> &identifiers, Json::Value &segmentVec)
+{
+    for (int i = 0; i < segmentVec.size(); i++){
+        map<int, int>::const_iterator it = identifiers.find(segmentVec[i]["adFound"].asInt());
+        if (it != identifiers.end())
+            segmentVec[i]["adFound"] = it->second;
+    }
+}
+
+/**
+    @brief Print the segment information and append it to the json array
+    @param segment camicasa::Segment already exported
+    @param segmentVec json array of segments
+    @param events camicasa::EventLog receiving a segmentExported event
+*/
+void reportSegment(Segment segment, Json::Value &segmentVec, EventLog &events)
+{
+    Json::Value segmentJson = segmentToJson(segment);
+
+    segmentVec.append(segmentJson);
+    events.write("segmentExported", segment.endTimestamp, segmentJson);
+
+    puts("");
+    cout << "Start " << stringifyTVChannelType(segment.type) << " of segment " << segment.id << " at " << formatTimestamp(segment.startTimestamp) << "\n";
+    if (segment.logoAssociated != -1)
+        cout << "Logo " << segment.logoAssociated << " was found in this segment\n";
+    cout << "End of segment " << segment.id << " at " << formatTimestamp(segment.endTimestamp) << "\n";
+}
+
+/// @brief struct LogoProbe with what is needed to look for the known logos at any frame of the input
+struct LogoProbe {
+    VideoCapture *vidCapture;
+    TVChannel *channel;
+    /// @brief index of the frames of the input, seeking by frame timestamps (NULL to seek with OpenCV)
+    FrameIndex *index;
+    /// @brief keyframes of the input in number of frames, sorted (empty if unknown)
+    vector<int> keyframes;
+    /// @brief buffers reused between frames
+    Mat frame;
+    Mat analysisFrame;
+    vector<LogoMatch> matches;
+};
+
+/**
+    @brief Read the next frame of the input and look for the known logos in it
+    @param probe LogoProbe
+    @param[out] timestamp position of the frame read in milliseconds
+    @returns returns true if a logo was found
+*/
+bool probeNextFrame(LogoProbe &probe, int &timestamp)
+{
+    *probe.vidCapture >> probe.frame;
+
+    if (probe.frame.empty())
+        return false;
+
+    timestamp = probe.vidCapture->get(CAP_PROP_POS_MSEC);
+
+    prepareAnalysisFrame(probe.frame, probe.analysisFrame, probe.channel->getAnalysisScale());
+
+    return probe.channel->matchLogos(probe.analysisFrame, probe.matches);
+}
+
+/**
+    @brief Seek to a frame of the input, through the index if there is one
+    @param probe LogoProbe
+    @param frame position of the frame in number of frames
+*/
+void seekFrame(LogoProbe &probe, int frame)
+{
+    if (probe.index == NULL || !probe.index->seek(*probe.vidCapture, frame))
+        probe.vidCapture->set(CAP_PROP_POS_FRAMES, frame);
+}
+
+/**
+    @brief Seek to a frame of the input and look for the known logos in it
+    @param probe LogoProbe
+    @param frame position of the frame in number of frames
+    @param[out] timestamp position of the frame read in milliseconds
+    @returns returns true if a logo was found
+*/
+bool probeFrame(LogoProbe &probe, int frame, int &timestamp)
+{
+    ScopedTrace trace("probeFrame");
+
+    seekFrame(probe, frame);
+
+    return probeNextFrame(probe, timestamp);
+}
+
+/**
+    @brief Choose the frame to probe between two frames, preferring a keyframe so the seek decodes a single frame
+    @param probe LogoProbe
+    @param low first frame of the range, excluded
+    @param high last frame of the range, excluded
+    @returns returns the frame to probe, -1 if the range is within a group of pictures and is better read frame by frame
+*/
+int chooseProbeFrame(LogoProbe &probe, int low, int high)
+{
+    int middle = low + (high - low) / 2;
+
+    if (probe.keyframes.empty())
+        return (high - low > probe.vidCapture->get(CAP_PROP_FPS)) ? middle : -1;
+
+    // the keyframe inside the range closest to its middle
+    vector<int>::iterator it = lower_bound(probe.keyframes.begin(), probe.keyframes.end(), middle);
+    int best = -1;
+
+    if (it != probe.keyframes.end() && *it > low && *it < high)
+        best = *it;
+
+    if (it != probe.keyframes.begin() && *(it - 1) > low && *(it - 1) < high &&
+        (best == -1 || middle - *(it - 1) < best - middle))
+        best = *(it - 1);
+
+    return best;
+}
+
+/**
+    @brief Find where the logo appears between a frame without it and a later frame with it (or the opposite)
+    @param probe LogoProbe
+    @param without frame where the logo is not
+    @param with frame where the logo is
+    @param[in,out] timestamp position in milliseconds of the frame with the logo, updated with the one found
+    @returns returns the frame with the logo next to a frame without it
+*/
+int refineBoundary(LogoProbe &probe, int without, int with, int &timestamp)
+{
+    // binary search while the range spans several groups of pictures
+    while (abs(with - without) > 1){
+        int frame = (without < with) ? chooseProbeFrame(probe, without, with) : chooseProbeFrame(probe, with, without);
+
+        if (frame == -1)
+            break;
+
+        int time = 0;
+        if (probeFrame(probe, frame, time)){
+            with = frame;
+            timestamp = time;
+        }
+        else
+            without = frame;
+    }
+
+    if (abs(with - without) <= 1)
+        return with;
+
+    // the rest is decoded in order, from the keyframe before it
+    int first = min(with, without) + 1;
+    int last = max(with, without) - 1;
+    int time = 0;
+
+    seekFrame(probe, first);
+
+    for (int frame = first; frame <= last; frame++){
+        if (!probeNextFrame(probe, time))
+            continue;
+
+        // the first frame with the logo after the start, the last one before the end
+        if (without < with){
+            timestamp = time;
+            return frame;
+        }
+
+        with = frame;
+        timestamp = time;
+    }
+
+    return with;
+}
+
+/**
+    @brief Trim the program segments to the first and last frames with a known logo, looking for them with exponential and
+    binary searches from each end of the segment
+    @param vidCapture opened cv::VideoCapture of the input
+    @param channel camicasa::TVChannel with the classified segments
+    @param fps number of frames per second of the input, with its fraction (e.g. 29.97)
+    @param keyframes keyframes of the input in milliseconds, probed first so seeks decode less (empty if unknown)
+    @param index index of the frames of the input, used for the seeks and to find the frames of the segments (NULL if unknown)
+    @note The logo is assumed to be present throughout the body of the program, so only a few frames are read from each
+    segment
+*/
+void trimSegments(VideoCapture &vidCapture, TVChannel *channel, double fps, const vector<int> &keyframes, FrameIndex *index)
+{
+    LogoProbe probe;
+    probe.vidCapture = &vidCapture;
+    probe.channel = channel;
+    probe.index = (index != NULL && !index->empty()) ? index : NULL;
+
+    if (probe.index != NULL)
+        probe.keyframes = probe.index->getKeyframes();
+    else
+        for (int i = 0; i < keyframes.size(); i++)
+            probe.keyframes.push_back((int)round(keyframes[i] * fps / 1000));
+
+    puts("");
+    puts("**** SEGMENT TRIMMING ****");
+
+    for (int i = 0; i < channel->getSegments().size(); i++)
+    {
+        Segment segment = channel->getSegments()[i];
+
+        if (segment.type != PROGRAM)
+            continue;
+
+        ScopedTrace trace("trimSegment");
+        trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+        int first = (int)round(segment.startTimestamp * fps / 1000);
+        int last = max(first, (int)(segment.endTimestamp * fps / 1000) - 1);
+
+        // with a variable frame rate only the timestamps of the frames tell where the segment is
+        if (probe.index != NULL){
+            first = min(probe.index->frameAt(segment.startTimestamp), probe.index->size() - 1);
+            last = max(first, probe.index->frameAt(segment.endTimestamp) - 1);
+        }
+
+        int newStart = segment.startTimestamp;
+        int newEnd = segment.startTimestamp;
+
+        // the jumps of the exponential searches stay within an eighth of the segment, so they do not skip over its body
+        int maximumJump = max(1, (last - first) / 8);
+
+        // exponential search from the start, one second further each time than the last
+        int without = first - 1;
+        int with = -1;
+        int startTime = 0;
+
+        for (int step = 1, frame = first; frame <= last && with == -1; step *= 2){
+            if (probeFrame(probe, frame, startTime))
+                with = frame;
+            else {
+                without = frame;
+                frame = (frame == last) ? last + 1 : min(last, frame + (int)min(step * fps, (double)maximumJump));
+            }
+        }
+
+        // no logo in the segment
+        if (with == -1){
+            channel->updateSegment(segment.id, newStart, newEnd);
+            continue;
+        }
+
+        if (without >= first)
+            refineBoundary(probe, without, with, startTime);
+
+        newStart = startTime;
+
+        // exponential search from the end, down to the frame with the logo found from the start
+        int endWithout = last + 1;
+        int endWith = with;
+        int endTime = startTime;
+
+        for (int step = 1, frame = last; frame > with; step *= 2){
+            int time = 0;
+
+            if (probeFrame(probe, frame, time)){
+                endWith = frame;
+                endTime = time;
+                break;
+            }
+
+            endWithout = frame;
+            frame = max(with, frame - (int)min(step * fps, (double)maximumJump));
+        }
+
+        if (endWithout <= last)
+            refineBoundary(probe, endWithout, endWith, endTime);
+
+        newEnd = endTime;
+
+        channel->updateSegment(segment.id, newStart, newEnd);
+    }
+}
+
+/**
+    @brief Read the video again, writing the frames of each segment in videos/segmentN.mp4
+    @param vidCapture opened cv::VideoCapture of the input, at its start
+    @param channel camicasa::TVChannel with the classified segments
+    @param fps number of frames per second of the input
+    @param frameSize size of the frames of the input
+    @param segmentVec json array of segments
+    @param events camicasa::EventLog receiving the exported segments
+    @param options camicasa::VideoOptions of the writers
+    @param directory output directory of the input (empty for the working directory)
+*/
+void exportSegments(VideoCapture &vidCapture, TVChannel *channel, int fps, Size frameSize, Json::Value &segmentVec, EventLog &events, const VideoOptions &options, string directory)
 {
-    VideoCapture vidCapture(argv[1]);
+    int timestamp = 0;
+    Mat frame;
+
+    for (int i = 0; i < channel->getSegments().size(); i++)
+    {
+        Segment segment = channel->getSegments().at(i);
+
+        ScopedTrace trace("exportSegment");
+        trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+        stringstream segmentWriter;
+        segmentWriter << outputPath(directory, "videos") << "/segment" << segment.id << ".mp4";
+
+        VideoWriter writer;
+
+        if (!openWriter(writer, segmentWriter.str(), fps, frameSize, options)){
+            puts("Error opening video writer");
+            writer.release();
+            continue;
+        }
+
+        while (vidCapture.isOpened() && timestamp < segment.endTimestamp)
+        {
+            vidCapture >> frame;
+
+            if (frame.empty()) {
+                puts("Video has been disconnected");
+                break;
+            }
+
+            timestamp = vidCapture.get(CAP_PROP_POS_MSEC);
+
+            if (timestamp >= segment.startTimestamp && timestamp <= segment.endTimestamp)
+                writer.write(frame);
+        }
+
+        reportSegment(segment, segmentVec, events);
+
+        writer.release();
+    }
+}
+
+/**
+    @brief Cut each segment straight from the input container in videos/segmentN.mp4
+    @param source path of the input
+    @param channel camicasa::TVChannel with the classified segments
+    @param keyframes keyframes of the input in milliseconds (empty if unknown)
+    @param segmentVec json array of segments
+    @param events camicasa::EventLog receiving the exported segments
+    @param directory output directory of the input (empty for the working directory)
+    @note See more in camicasa::copySegment()
+*/
+void copySegments(string source, TVChannel *channel, vector<int> &keyframes, Json::Value &segmentVec, EventLog &events, string directory)
+{
+    StreamParameters parameters;
+    if (!probeStreams(source, parameters))
+        puts("Streams of the input not found, segments will be re-encoded");
+
+    if (keyframes.empty())
+        puts("No keyframes found, segments will be re-encoded");
+
+    for (int i = 0; i < channel->getSegments().size(); i++)
+    {
+        Segment segment = channel->getSegments().at(i);
+
+        ScopedTrace trace("copySegment");
+        trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+        stringstream segmentWriter;
+        segmentWriter << outputPath(directory, "videos") << "/segment" << segment.id << ".mp4";
+
+        if (!copySegment(source, parameters, keyframes, segment, segmentWriter.str()))
+            puts("Error copying segment");
+
+        reportSegment(segment, segmentVec, events);
+    }
+}
+
+/// @brief struct AnalysisOptions with how each input is analysed, given by the command line
+struct AnalysisOptions {
+    // with a single pass, segments are trimmed and written while the frames are classified
+    bool singlePass = false;
+    // with a pipeline, decoding and encoding run on their own threads (implies a single pass)
+    bool pipeline = false;
+    int encoderCount = 1;
+    int queueDepth = 32;
+    // seconds of frames a single pass holds in memory while it waits for a logo, the rest are spilled to disk
+    int heldSeconds = 10;
+    // with chunks, ranges of the input are analysed in parallel (0 for one per core) and then trimmed and written
+    int chunkCount = -1;
+    // with stream copy, segments are cut from the input container instead of re-encoded (needs ffmpeg)
+    bool streamCopy = false;
+    // step between the rows averaged when checking for black frames
+    int blackFrameStride = 1;
+    // scale of the grayscale frames analysed (0 to analyse the frames of the input), they are only written at full size
+    double analysisScale = 0;
+    // with live, the input (a pipe, a camera or a network stream) is read once and each segment is reported as it closes
+    bool live = false;
+    // frames per second of the input when it does not tell (0 to ask the input)
+    int inputFps = 0;
+    // seconds of input between checkpoints of the classification (0 for none), which --resume continues from
+    int checkpointInterval = 0;
+    bool resume = false;
+    // maximum number of frames between the frames classified while a segment is stable, 1 to classify all of them
+    int samplingStep = 1;
+    // logos of the channel found by previous runs are kept in the library (empty for none, the default, so runs stay apart),
+    // matching from the first frame
+    string channelName = "default";
+    string libraryDirectory;
+    // ads found by previous runs are fingerprinted in the index (empty for none), identified from their first seconds
+    string adIndexDirectory;
+    // columns and rows of the grid of tiles along the edges of the screen where logos are searched
+    int gridColumns = 7;
+    int gridRows = 5;
+    // backends, decoder threads and properties of every input and written segment opened
+    VideoOptions videoOptions;
+};
+
+/// @brief struct AnalysisResult with what the analysis of an input went through
+struct AnalysisResult {
+    bool analysed = false;
+    /// @brief number of frames of the input
+    long long frames = 0;
+    /// @brief duration of the input in milliseconds
+    int duration = 0;
+};
+
+/**
+    @brief Analyse an input, writing its segments, logos, json.json and events.ndjson in the given directory
+    @param source path or URL of the input, a number for a camera or "-" for the standard input
+    @param options AnalysisOptions of the analysis
+    @param directory output directory of the input (empty for the working directory)
+    @returns returns the AnalysisResult, not analysed if the input could not be opened
+*/
+AnalysisResult analyzeInput(string source, AnalysisOptions options, string directory)
+{
+    VideoCapture vidCapture;
+    openInput(vidCapture, source, options.videoOptions);
+
+    AnalysisResult result;
 
     if (!vidCapture.isOpened()){
 		puts("Error opening video stream or file");
 		// Release the video capture object
 		vidCapture.release();
-		cv::destroyAllWindows();
-		return 0;
+		return result;
 	}
 
     // obtain frame information
 	int frameWidth = vidCapture.get(CAP_PROP_FRAME_WIDTH);
 	int frameHeight = vidCapture.get(CAP_PROP_FRAME_HEIGHT);
-    int fps = vidCapture.get(CAP_PROP_FPS);
+    double frameRate = options.inputFps > 0 ? options.inputFps : vidCapture.get(CAP_PROP_FPS);
+
+    // pipes and streams may not tell their frame rate
+    if (frameRate <= 0)
+        frameRate = 25;
+
+    // the writers take whole frame rates, the seeks of the trimming need the exact one (e.g. 29.97)
+    int fps = (int)frameRate;
+    if (fps <= 0)
+        fps = 1;
 
     cout << "Frame width: " << frameWidth << "\n";
     cout << "Frame height: " << frameHeight << "\n";
-    cout << "FPS: " << fps << "\n\n";
+    cout << "FPS: " << fps << "\n";
+    cout << "Decoder threads: " << (int)vidCapture.get(CAP_PROP_N_THREADS) << "\n\n";
 
-    // reset folders to store retrieved data
-    system("rm -r videos");
-    system("rm -r logos");
-    mkdir("videos", 0777);
-    mkdir("logos", 0777);
+    // frames of the input, counted while reading it when it does not tell
+    long long frameCount = max(0.0, vidCapture.get(CAP_PROP_FRAME_COUNT));
 
+    // chunks are split by the frame count, an input that does not tell it is read in a single pass
+    if (options.chunkCount > 0 && frameCount <= 0){
+        puts("The input does not tell its number of frames, analysed without chunks\n");
+        options.chunkCount = -1;
+    }
 
     // minimum time in seconds for a segment to be considered a program
     int minimumTime = 60;
     int timestamp = 0;
 
     TVChannel *channel = new TVChannel(frameWidth, frameHeight, fps, minimumTime);
+    channel->setBlackFrameStride(options.blackFrameStride);
+    channel->setAnalysisScale(options.analysisScale);
+    channel->setLogoGrid(options.gridColumns, options.gridRows);
+
+    // logos are kept in the library in the coordinates of the analysed frames
+    Size librarySize = analysisSize(Size(frameWidth, frameHeight), options.analysisScale);
+    LogoLibrary *library = NULL;
+
+    if (!options.libraryDirectory.empty()){
+        library = new LogoLibrary(options.libraryDirectory);
+        library->open();
 
-    /**
-     **** LOGO DETECTION ****
-     */
-    // variables used to control states
-    bool logoAlreadyFound = false;
+        vector<Logo> knownLogos = library->findLogos(options.channelName, librarySize);
+        for (int i = 0; i < knownLogos.size(); i++)
+            channel->addLogo(knownLogos[i]);
+
+        if (!knownLogos.empty())
+            cout << knownLogos.size() << " logos of channel " << options.channelName << " loaded from the library\n\n";
+    }
 
-    Logo currentLogo;
+    AdIndex *adIndex = NULL;
+
+    if (!options.adIndexDirectory.empty()){
+        adIndex = new AdIndex(options.adIndexDirectory);
+        adIndex->open();
+
+        // segments of chunks start and end at their boundaries, so their ads are added once stitched
+        channel->setAdIndex(adIndex, options.chunkCount <= 0);
+
+        if (adIndex->size() > 0)
+            cout << adIndex->size() << " ads loaded from the ad index\n\n";
+    }
 
-    // variables used to store frames
-    Mat currentFrame;
-    Mat previousFrame;
-    Mat operationBitwise;
+    // index of the frames of the input for the seeks of the second pass, kept next to it for the next runs
+    FrameIndex frameIndex;
+    thread frameIndexer;
 
-    /**
-     **** SEGMENT CLASSIFICATION ****
-     */
-    // variables used to control states
-    bool alreadyBlack = false;
-    bool startSegment = false;
+    if (!options.singlePass && !frameIndex.load(frameIndexPath(source), source))
+        frameIndexer = thread(buildFrameIndex, source, &frameIndex);
 
-    Segment currentSegment;
+    // continue the classification from the last checkpoint, keeping the logos already written
+    int frameNumber = 0;
+    bool resumed = options.resume && channel->loadCheckpoint(outputPath(directory, "checkpoint.yml"), timestamp, frameNumber);
 
+    if (resumed){
+        cout << "Resuming from " << formatTimestamp(timestamp) << "\n\n";
+
+        // an index still being built is not read until it is joined
+        if (frameIndexer.joinable() || !frameIndex.seek(vidCapture, frameNumber))
+            vidCapture.set(CAP_PROP_POS_FRAMES, frameNumber);
+    }
+    else {
+        if (options.resume)
+            puts("No checkpoint to resume from, starting from the beginning\n");
+
+        // reset folders to store retrieved data
+        system(("rm -r " + quoteArgument(outputPath(directory, "videos"))).c_str());
+        system(("rm -r " + quoteArgument(outputPath(directory, "logos"))).c_str());
+    }
+
+    mkdir(outputPath(directory, "videos").c_str(), 0777);
+    mkdir(outputPath(directory, "logos").c_str(), 0777);
+    SegmentExporter exporter(channel, outputPath(directory, "videos"), fps, Size(frameWidth, frameHeight), options.heldSeconds * fps, options.videoOptions);
+
+    // pipeline threads, each pair of threads sharing a single producer single consumer queue
+    BoundedQueue<DecodedFrame> *decoderQueue = NULL;
+    vector<BoundedQueue<EncodeJob>*> encoderQueues;
+    vector<SegmentEncoder*> encoders;
+    vector<thread> threads;
+
+    if (options.pipeline){
+        decoderQueue = new BoundedQueue<DecodedFrame>(options.queueDepth);
+        threads.push_back(thread(decodeFrames, &vidCapture, decoderQueue, options.analysisScale, &stopRequested));
+
+        for (int i = 0; i < options.encoderCount; i++){
+            encoderQueues.push_back(new BoundedQueue<EncodeJob>(options.queueDepth));
+            encoders.push_back(new SegmentEncoder(outputPath(directory, "videos"), fps, Size(frameWidth, frameHeight), options.videoOptions));
+            threads.push_back(thread(encodeSegments, encoderQueues[i], encoders[i]));
+        }
+
+        exporter.setEncoderQueues(encoderQueues);
+    }
+
+    // events flushed as they happen, compacted into json.json by the compact tool if the analysis does not finish
+    EventLog events(outputPath(directory, "events.ndjson"), resumed);
 
     // json variables
-    Json::Value json;
     Json::Value logoVec(Json::arrayValue);
     Json::Value segmentVec(Json::arrayValue);
 
+    // logos known before the analysis, from the library or the checkpoint
+    int knownLogos = channel->getLogos().size();
+
+    for (int i = 0; i < knownLogos; i++){
+        if (resumed)
+            logoVec.append(logoToJson(channel->getLogos()[i], options.analysisScale));
+        else
+            reportLogo(channel->getLogos()[i], logoVec, options.analysisScale, events, 0, directory);
+    }
+
     puts("**** LOGO DETECTION AND SEGMENT CLASSIFICATION ****");
 
+    if (options.chunkCount > 0){
+        vector<Chunk> chunks = splitChunks(frameCount, options.chunkCount);
+
+        for (int i = 0; i < chunks.size(); i++)
+            threads.push_back(thread(analyzeChunk, source, *channel, &chunks[i], options.samplingStep, options.videoOptions));
+
+        for (int i = 0; i < threads.size(); i++)
+            threads[i].join();
+
+        threads.clear();
+
+        stitchChunks(chunks, channel);
+        channel->rememberAds();
+
+        for (int i = knownLogos; i < channel->getLogos().size(); i++)
+            reportLogo(channel->getLogos()[i], logoVec, options.analysisScale, events, 0, directory);
+    }
+
+    if (options.live){
+        signal(SIGINT, requestStop);
+        signal(SIGTERM, requestStop);
+    }
+
     // first reading of all frames to detect logos and classify segments
-    while (vidCapture.isOpened()){
-        Mat frame;
-        vidCapture >> frame;
+    DecodedFrame decoded;
+    // frames written on the way are all needed, so only the classification of a file can skip some
+    FrameScheduler *scheduler = (!options.singlePass && options.samplingStep > 1) ? new FrameScheduler(channel, fps, options.samplingStep) : NULL;
+    // frames read from a live input, which is timed by them as its own positions may be missing or not start at 0
+    long long liveFrames = 0;
+    long long framesRead = 0;
+    int lastCheckpoint = timestamp;
+
+    while (options.chunkCount <= 0){
+        // the decoder thread sees the stop request too and ends the queue with an empty frame
+        if (options.pipeline){
+            ScopedTrace trace("waitDecoder");
+            decoderQueue->pop(decoded);
+        }
+        else if (stopRequested)
+            decoded.frame = Mat();
+        else
+            scheduler != NULL ? scheduler->read(vidCapture, decoded, options.analysisScale) : readFrame(vidCapture, decoded, options.analysisScale);
+
+        Mat &frame = decoded.frame;
         if (frame.empty()){
-            if (startSegment)
-            {
-                currentSegment.endTimestamp = timestamp;
-
-                channel->addSegment(currentSegment);
-                logoAlreadyFound = false;
-                
-                // reset currentSegment
-                currentSegment.id++;
-                currentSegment.type = AD;
-                currentSegment.logoAssociated = -1;
+            if (channel->finishStream(timestamp) & SEGMENT_CLOSED){
+                events.write("segmentClosed", timestamp, segmentToJson(channel->getSegments().back()));
+
+                if (options.singlePass)
+                    reportSegment(exporter.closeSegment(frame), segmentVec, events);
             }
             break;
         }
 
-        timestamp = vidCapture.get(CAP_PROP_POS_MSEC);
+        framesRead++;
 
-        if (!alreadyBlack && screenThresholdDetection(frame))
-        {
-            if (startSegment)
-            {
-                currentSegment.endTimestamp = timestamp;
+        if (options.live){
+            liveFrames++;
+            decoded.timestamp = (int)(liveFrames * 1000 / frameRate);
+            decoded.frameNumber = (int)liveFrames;
+        }
 
-                channel->addSegment(currentSegment);
+        timestamp = decoded.timestamp;
 
-                startSegment = false;
-                logoAlreadyFound = false;
+        int changes = channel->processFrame(decoded.analysisFrame, timestamp, decoded.frameNumber, decoded.black);
 
-                // reset currentSegment
-                currentSegment.id++;
-                currentSegment.type=AD;
-                currentSegment.logoAssociated= -1;
-            }
+        if (changes & SEGMENT_OPENED)
+            events.write("segmentOpened", timestamp, segmentToJson(channel->getCurrentSegment()));
 
-            alreadyBlack = true;
-        }
-        else
-        {
-            if (alreadyBlack && !screenThresholdDetection(frame))
-                alreadyBlack = false;
+        // a frame may show several new logos at once
+        if (changes & LOGO_FOUND)
+            for (int i = logoVec.size(); i < channel->getLogos().size(); i++)
+                reportLogo(channel->getLogos()[i], logoVec, options.analysisScale, events, timestamp, directory);
 
-            if (!startSegment)
-            {
-                currentSegment.startTimestamp = timestamp;
-                startSegment = true;
-            }
+        if (changes & SEGMENT_RETYPED)
+            events.write("segmentRetyped", timestamp, segmentToJson(channel->getCurrentSegment()));
 
-            if (alreadyBlack)
-                continue;
-
-            if (!logoAlreadyFound && currentSegment.type != PROGRAM)
-            for (Logo logo : channel->getLogos())
-                if (channel->findPatternLogo(frame, logo)){
-                    cout << "Segment " << currentSegment.id << " changed to program because a logo was found\n";
-                    currentSegment.type = PROGRAM;
-                    logoAlreadyFound = true;
-                    break;
-                }
-
-            // change segment type after a certain time has passed
-            int passedTime = (timestamp - currentSegment.startTimestamp) / 1000;
-            if (currentSegment.type != PROGRAM && channel->hasMinimumTimePassed(passedTime)){
-                cout << "Segment " << currentSegment.id << " changed to program because of time\n";
-                currentSegment.type = PROGRAM;
-            }
+        if (changes & AD_IDENTIFIED)
+            events.write("adIdentified", timestamp, segmentToJson(channel->getCurrentSegment()));
 
+        if (changes & SEGMENT_CLOSED)
+            events.write("segmentClosed", timestamp, segmentToJson(channel->getSegments().back()));
 
-            if (!logoAlreadyFound)
-            {
-                // reduce the number of frames to search for a logo if none found
-                int frameNumber = vidCapture.get(CAP_PROP_POS_FRAMES);
-                if (frameNumber % fps == 0){
+        if (options.checkpointInterval > 0 && timestamp - lastCheckpoint >= options.checkpointInterval * 1000){
+            channel->saveCheckpoint(outputPath(directory, "checkpoint.yml"), timestamp, decoded.frameNumber);
+            lastCheckpoint = timestamp;
+        }
 
-                if (previousFrame.empty())
-                {
-                    currentFrame = frame.clone();
+        if (!options.singlePass)
+            continue;
 
-                    previousFrame = currentFrame.clone();
-                    operationBitwise = previousFrame.clone();
-                    continue;
-                }
+        if (changes & SEGMENT_CLOSED)
+            reportSegment(exporter.closeSegment(frame), segmentVec, events);
 
-                previousFrame = currentFrame.clone();
-                currentFrame = frame.clone();
+        if (channel->isSegmentOpen())
+            exporter.addFrame(frame, decoded.analysisFrame, timestamp);
 
-                bitwise_and(operationBitwise, currentFrame, operationBitwise);
+        // report right away instead of at the end of an input that may never end
+        if (options.live && (changes & (LOGO_FOUND | SEGMENT_CLOSED))){
+            writeJson(logoVec, segmentVec, directory);
+            cout.flush();
+        }
+    }
 
-                Mat operationBitwiseGray;
-                cvtColor(operationBitwise, operationBitwiseGray, COLOR_BGR2GRAY);
+    if (scheduler != NULL){
+        cout << "\nClassified " << scheduler->getAnalysedFrames() << " frames, skipped " << scheduler->getSkippedFrames()
+             << " and read again around " << scheduler->getRewinds() << " black frames\n";
+        delete scheduler;
+    }
 
-                channel->checkForSaturatedCorners(operationBitwiseGray, CHECK_SMALLER, 5);
+    if (options.pipeline){
+        EncodeJob stop;
+        stop.command = STOP_ENCODING;
 
-                channel->findLogo(currentFrame, operationBitwise, currentLogo);
-               
-                // no logo found
-                if (currentLogo.screenCorner == NONE)
-                    continue;
+        for (int i = 0; i < encoderQueues.size(); i++)
+            encoderQueues[i]->push(stop);
 
-                logoAlreadyFound = true;
-                cout << "Segment " << currentSegment.id << " found a logo at the " << stringifyScreenCorner(currentLogo.screenCorner) << "!\n";
+        for (int i = 0; i < threads.size(); i++)
+            threads[i].join();
 
-                stringstream logoWriter;
-                logoWriter << "logos/logo" << currentLogo.id << ".jpg";
-                imwrite(logoWriter.str(), currentLogo.image);
+        for (int i = 0; i < encoderQueues.size(); i++){
+            delete encoderQueues[i];
+            delete encoders[i];
+        }
 
-                channel->addLogo(currentLogo);
-                 
-                Json::Value logoJson;
-                
-                logoJson["id"] = currentLogo.id;
-                logoJson["x"] = currentLogo.x;
-                logoJson["y"] = currentLogo.y;
-                logoJson["width"] = currentLogo.width;
-                logoJson["height"] = currentLogo.height;
-                logoJson["corner"] = stringifyScreenCorner(currentLogo.screenCorner);
+        delete decoderQueue;
+    }
 
-                logoVec.append(logoJson);
+    if (frameIndexer.joinable())
+        frameIndexer.join();
 
-                if (currentSegment.type != PROGRAM){
-                    currentSegment.type = PROGRAM;
-                    cout << "Segment " << currentSegment.id << " changed to program because a logo was detected\n";
-                }
+    if (!options.singlePass){
+        // reading video again, but this time to write frames in disk relative to each segment,
+        // trimming start and end timestamps if necessary
 
-                currentSegment.logoAssociated = currentLogo.id;
+        openInput(vidCapture, source, options.videoOptions);
 
-                currentLogo.id++;
+        if (!vidCapture.isOpened())
+        {
+            puts("Error opening video stream or file");
+            // Release the video capture object
+            vidCapture.release();
+            delete library;
+            delete adIndex;
+            delete channel;
+            return result;
+        }
 
-                }
-            }
+        // listed once for the seeks of the trimming and the cuts of the stream copy
+        vector<int> keyframes = frameIndex.empty() ? findKeyframes(source) : frameIndex.getKeyframeTimestamps();
 
-            if (!channel->hasStillFrames())
-            {
-                operationBitwise = previousFrame;
+        trimSegments(vidCapture, channel, frameRate, keyframes, &frameIndex);
 
-                if (logoAlreadyFound){
-                    currentSegment.endTimestamp = timestamp;
-                    logoAlreadyFound = false;
-                }
+        if (options.streamCopy)
+            copySegments(source, channel, keyframes, segmentVec, events, directory);
+        else {
+            openInput(vidCapture, source, options.videoOptions);
 
-            }
+            exportSegments(vidCapture, channel, fps, Size(frameWidth, frameHeight), segmentVec, events, options.videoOptions, directory);
         }
     }
 
-    // reading video again, but this time to write frames in disk relative to each segment, 
-    // trimming start and end timestamps if necessary
+    // merged before json.json is written, so it reports the identifiers the library and the ad index keep
+    if (library != NULL){
+        map<int, int> identifiers;
+        int added = library->merge(options.channelName, librarySize, channel->getLogos(), identifiers);
+        if (added > 0)
+            cout << added << " new logos of channel " << options.channelName << " merged into the library\n";
+
+        renumberLogos(identifiers, logoVec, segmentVec, directory);
+        delete library;
+    }
 
-    vidCapture.open(argv[1]);
+    if (adIndex != NULL){
+        map<int, int> identifiers;
+        int added = adIndex->merge(identifiers);
+        if (added > 0)
+            cout << added << " new ads merged into the ad index\n";
 
-    if (!vidCapture.isOpened())
-    {
-        puts("Error opening video stream or file");
-        // Release the video capture object
-        vidCapture.release();
-        cv::destroyAllWindows();
-        return 0;
+        renumberAds(identifiers, segmentVec);
+        delete adIndex;
     }
 
-    puts("");
-    puts("**** SEGMENT TRIMMING ****");
+    // writing thee json object
+    writeJson(logoVec, segmentVec, directory);
 
-    for (int i = 0; i < channel->getSegments().size(); i++)
-    {
-        Segment segment = channel->getSegments()[i];
+    // the run finished, the next one starts from the beginning
+    if (options.checkpointInterval > 0 || resumed)
+        remove(outputPath(directory, "checkpoint.yml").c_str());
 
-        if (segment.type != PROGRAM)
-            continue;
+    // skipped frames (sampling, chunks, a resumed start) count as analysed
+    result.analysed = true;
+    result.frames = (frameCount > 0) ? frameCount : framesRead;
+    result.duration = (int)(result.frames * 1000 / frameRate);
 
-        int time = 0;
-        int newStart = segment.startTimestamp;
-        int newEnd = segment.startTimestamp;
-        bool foundNewStart = false;
+    delete channel;
+    vidCapture.release();
 
-        int frameStart = (segment.startTimestamp/1000) * fps;
-        vidCapture.set(CAP_PROP_POS_FRAMES, frameStart);
+    return result;
+}
 
-        while (vidCapture.isOpened() && time < segment.endTimestamp){
-            Mat frame;
-            vidCapture >> frame;
+/**
+    @brief List the recordings of a batch
+    @param path directory with the recordings, or a file with a path per line (empty lines and lines starting with # are skipped)
+    @returns returns the paths of the recordings, sorted for a directory
+*/
+vector<string> listInputs(string path)
+{
+    vector<string> inputs;
+    struct stat status;
 
-            if (frame.empty())
-            {
-                puts("Video has been disconnected");
+    if (stat(path.c_str(), &status) != 0)
+        return inputs;
+
+    if (!S_ISDIR(status.st_mode)){
+        ifstream list(path);
+        string line;
+
+        while (getline(list, line)){
+            // lists written on Windows
+            if (!line.empty() && line.back() == '\r')
+                line.pop_back();
+
+            if (!line.empty() && line[0] != '#')
+                inputs.push_back(line);
+        }
+        return inputs;
+    }
+
+    const char *extensions[] = {".mp4", ".mkv", ".ts", ".avi", ".mov", ".mpg", ".mpeg", ".m2ts", ".flv", ".webm"};
+
+    DIR *directory = opendir(path.c_str());
+    if (directory == NULL)
+        return inputs;
+
+    struct dirent *entry;
+    while ((entry = readdir(directory)) != NULL){
+        string name = entry->d_name;
+        string file = outputPath(path, name);
+
+        if (stat(file.c_str(), &status) != 0 || !S_ISREG(status.st_mode))
+            continue;
+
+        size_t dot = name.rfind('.');
+        if (dot == string::npos)
+            continue;
+
+        string extension = name.substr(dot);
+        transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+
+        for (int i = 0; i < sizeof(extensions) / sizeof(extensions[0]); i++)
+            if (extension == extensions[i]){
+                inputs.push_back(file);
                 break;
             }
+    }
+    closedir(directory);
+
+    sort(inputs.begin(), inputs.end());
+    return inputs;
+}
+
+/**
+    @brief Read the memory available for new processes without swapping, which counts the page cache the kernel can reclaim
+    @returns returns the available memory in bytes, -1 if /proc/meminfo does not tell it
+*/
+long long availableMemory()
+{
+    ifstream meminfo("/proc/meminfo");
+    string key;
+    long long value;
+    string unit;
+
+    while (meminfo >> key >> value){
+        getline(meminfo, unit);
+
+        if (key == "MemAvailable:")
+            return value * 1024;
+    }
+
+    return -1;
+}
+
+/**
+    @brief Estimate the memory the analysis of a recording takes at most, from the frames it holds at once
+    @param options AnalysisOptions of the recording
+    @param frameSize size of the frames of the recording
+    @param fps number of frames per second of the recording
+    @returns returns the memory in bytes
+*/
+long long inputMemory(const AnalysisOptions &options, Size frameSize, double fps)
+{
+    long long frameBytes = (long long)frameSize.width * frameSize.height * 3;
+
+    // frames analysed in grayscale at their scale, or the frames of the input themselves
+    Size scaled = analysisSize(frameSize, options.analysisScale);
+    long long analysisBytes = (options.analysisScale > 0) ? (long long)scaled.width * scaled.height : 0;
+
+    // the frame read and the sampled frames of the logo search, per chunk with chunks
+    long long frames = 4 * max(1, options.chunkCount);
 
-            time = vidCapture.get(CAP_PROP_POS_MSEC);
-
-            for (Logo logo : channel->getLogos())
-                if (channel->findPatternLogo(frame, logo))
-                {
-                    if (!foundNewStart)
-                    {
-                        newStart = time;
-                        foundNewStart = true;
-                    }
-
-                    newEnd = time;
-                    break;
-                }
-            
+    if (options.pipeline)
+        frames += (long long)options.queueDepth * (1 + options.encoderCount);
+
+    long long memory = frames * (frameBytes + analysisBytes);
+
+    // the frames of a segment a single pass holds before spilling them to disk
+    if (options.singlePass)
+        memory += (long long)(options.heldSeconds * fps) * (frameBytes + analysisBytes);
+
+    // the decoder, the encoders and their reference frames
+    return memory + (128LL << 20);
+}
+
+/**
+    @brief Find how many recordings of a batch are analysed at once, so the threads of each one have their own core
+    and the frames they hold fit in the available memory
+    @param options AnalysisOptions of each recording
+    @param frameSize size of the frames of the recordings, as the first one tells
+    @param fps number of frames per second of the recordings, as the first one tells
+    @returns returns the number of workers, at least 1
+*/
+int defaultWorkerCount(const AnalysisOptions &options, Size frameSize, double fps)
+{
+    int cores = max(1, (int)thread::hardware_concurrency());
+
+    // the analysis, plus the decoder and encoders of the pipeline or a thread per chunk
+    int threadsPerInput = 1;
+    if (options.chunkCount > 0)
+        threadsPerInput = options.chunkCount;
+    else if (options.pipeline)
+        threadsPerInput = 2 + options.encoderCount;
+
+    int workers = max(1, cores / threadsPerInput);
+
+    long long available = availableMemory();
+    if (available > 0)
+        workers = min(workers, max(1, (int)(available / inputMemory(options, frameSize, fps))));
+
+    return workers;
+}
+
+/**
+    @brief Worker of a batch, analysing the next recording not taken by another worker until none is left
+    @param worker number of the worker, naming its thread in the trace
+    @param inputs paths of the recordings
+    @param directories output directory of each recording
+    @param options AnalysisOptions of each recording
+    @param next index of the next recording to take
+    @param results AnalysisResult of each recording
+*/
+void batchWorker(int worker, const vector<string> *inputs, const vector<string> *directories, AnalysisOptions options, atomic<int> *next, vector<AnalysisResult> *results)
+{
+    nameTraceThread("worker " + to_string(worker));
+
+    int i;
+    while ((i = (*next)++) < inputs->size()){
+        cout << "Worker " << worker << " analysing " << inputs->at(i) << " into " << directories->at(i) << "\n";
+
+        mkdir(directories->at(i).c_str(), 0777);
+        results->at(i) = analyzeInput(inputs->at(i), options, directories->at(i));
+
+        if (!results->at(i).analysed)
+            cout << "Worker " << worker << " could not analyse " << inputs->at(i) << "\n";
+    }
+}
+
+/**
+    @brief Analyse every recording of a batch with a pool of workers, each recording in its own output directory
+    @param path directory with the recordings, or a file with a path per line
+    @param options AnalysisOptions of each recording
+    @param workerCount number of recordings analysed at once (0 to fit the cores and the available memory)
+    @param outputRoot directory where the output directory of each recording is created
+    @returns returns the number of recordings that could not be analysed
+*/
+int analyzeBatch(string path, AnalysisOptions options, int workerCount, string outputRoot)
+{
+    vector<string> inputs = listInputs(path);
+
+    if (inputs.empty()){
+        cout << "No recordings found in " << path << "\n";
+        return 1;
+    }
+
+    // each recording is written in outputRoot/<name of the recording>, numbered when names repeat
+    mkdir(outputRoot.c_str(), 0777);
+    vector<string> directories;
+    set<string> names;
+
+    for (int i = 0; i < inputs.size(); i++){
+        string name = inputs[i].substr(inputs[i].find_last_of('/') + 1);
+        size_t dot = name.rfind('.');
+        if (dot != string::npos && dot > 0)
+            name = name.substr(0, dot);
+
+        string unique = name;
+        for (int n = 2; names.count(unique); n++)
+            unique = name + "-" + to_string(n);
+
+        names.insert(unique);
+        directories.push_back(outputPath(outputRoot, unique));
+    }
+
+    if (workerCount <= 0){
+        // the recordings of a batch usually come from the same source, sized by the first one (1080p at 30 fps if it does not tell)
+        Size frameSize(1920, 1080);
+        double fps = 30;
+
+        VideoCapture probe;
+        if (openInput(probe, inputs[0], options.videoOptions)){
+            if (probe.get(CAP_PROP_FRAME_WIDTH) > 0 && probe.get(CAP_PROP_FRAME_HEIGHT) > 0)
+                frameSize = Size(probe.get(CAP_PROP_FRAME_WIDTH), probe.get(CAP_PROP_FRAME_HEIGHT));
+            if (probe.get(CAP_PROP_FPS) > 0)
+                fps = probe.get(CAP_PROP_FPS);
         }
+        probe.release();
 
-        channel->updateSegment(segment.id, newStart, newEnd);
-        
+        workerCount = defaultWorkerCount(options, frameSize, fps);
     }
+    workerCount = min(workerCount, (int)inputs.size());
 
+    cout << "Analysing " << inputs.size() << " recordings with " << workerCount << " workers\n\n";
 
-    vidCapture.open(argv[1]);
-    timestamp = 0;
+    atomic<int> next(0);
+    vector<AnalysisResult> results(inputs.size());
+    vector<thread> workers;
 
-    for (int i = 0; i < channel->getSegments().size(); i++)
-    {
-        Segment segment = channel->getSegments().at(i);
+    auto start = chrono::steady_clock::now();
 
-        stringstream segmentWriter;
-        segmentWriter << "videos/segment" << segment.id << ".mp4";
+    for (int i = 0; i < workerCount; i++)
+        workers.push_back(thread(batchWorker, i, &inputs, &directories, options, &next, &results));
 
-        VideoWriter writer(segmentWriter.str(), VideoWriter::fourcc('a', 'v', 'c', '1'), fps, Size(frameWidth, frameHeight));
+    for (int i = 0; i < workers.size(); i++)
+        workers[i].join();
 
-        if (!writer.isOpened()){
-            puts("Error opening video writer");
-            writer.release();
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    int analysed = 0;
+    long long frames = 0;
+    long long duration = 0;
+
+    for (int i = 0; i < results.size(); i++){
+        if (!results[i].analysed)
             continue;
-        }
 
-        while (vidCapture.isOpened() && timestamp < segment.endTimestamp)
-        {
-            Mat frame;
-            vidCapture >> frame;
+        analysed++;
+        frames += results[i].frames;
+        duration += results[i].duration;
+    }
 
-            if (frame.empty()) {
-                puts("Video has been disconnected");
-                break;
-            }
+    cout << "\nAnalysed " << analysed << " of " << inputs.size() << " recordings (" << inputs.size() - analysed << " failed)\n";
+    cout << "Frames: " << frames << ", video duration: " << formatTimestamp((int)duration) << ", wall time: " << formatTimestamp((int)(elapsed * 1000)) << "\n";
+    if (elapsed > 0)
+        cout << "Throughput: " << frames / elapsed << " fps, " << duration / 1000.0 / elapsed << "x realtime\n";
 
-            timestamp = vidCapture.get(CAP_PROP_POS_MSEC);
-            
-            if (timestamp >= segment.startTimestamp && timestamp <= segment.endTimestamp)
-                writer.write(frame);
-        }
+    return inputs.size() - analysed;
+}
 
-        Json::Value segmentJson;
+int main(int argc, char** argv)
+{
+    bool batch = argc >= 3 && !strcmp(argv[1], "--batch");
 
-        segmentJson["id"] = segment.id;
-        segmentJson["startTimestamp"] = segment.startTimestamp;
-        segmentJson["endTimestamp"] = segment.endTimestamp;
-        segmentJson["type"] = stringifyTVChannelType(segment.type);
-        segmentJson["logoFound"] = segment.logoAssociated;
+    if (argc < 2 || (!strcmp(argv[1], "--batch") && !batch)){
+        puts("Usage: sic <video> [options]");
+        puts("       sic --batch <directory|list> [--workers N] [--output-dir DIR] [options]");
+        puts("Options: [--single-pass] [--pipeline] [--encoders N] [--queue-depth N] [--chunks N] [--stream-copy] [--black-stride N] [--analysis-scale S] [--live] [--fps N] [--checkpoint-interval S] [--resume] [--channel NAME] [--library DIR] [--ad-index DIR] [--sampling-step N] [--logo-grid CxR] [--backend NAME] [--writer-backend NAME] [--decoder-threads N] [--buffer-size N] [--capture-property ID=VALUE] [--writer-property ID=VALUE] [--trace PATH]");
+        return 0;
+    }
 
-        segmentVec.append(segmentJson);
-        
-        puts("");
-        cout << "Start " << stringifyTVChannelType(segment.type) << " of segment " << segment.id << " at " << formatTimestamp(segment.startTimestamp) << "\n";
-        if (segment.logoAssociated != -1)
-            cout << "Logo " << segment.logoAssociated << " was found in this segment\n";
-        cout << "End of segment " << segment.id << " at " << formatTimestamp(segment.endTimestamp) << "\n";
+    AnalysisOptions options;
+    // Chrome trace of the time spent in each stage (empty for none)
+    string tracePath;
+    // recordings of a batch analysed at once (0 to fit the cores and the available memory)
+    int workerCount = 0;
+    string outputRoot = "batch";
+
+    for (int i = batch ? 3 : 2; i < argc; i++){
+        if (!strcmp(argv[i], "--single-pass"))
+            options.singlePass = true;
+        else if (!strcmp(argv[i], "--pipeline"))
+            options.pipeline = options.singlePass = true;
+        else if (!strcmp(argv[i], "--encoders") && i + 1 < argc)
+            options.encoderCount = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--queue-depth") && i + 1 < argc)
+            options.queueDepth = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--chunks") && i + 1 < argc)
+            options.chunkCount = max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--stream-copy"))
+            options.streamCopy = true;
+        else if (!strcmp(argv[i], "--black-stride") && i + 1 < argc)
+            options.blackFrameStride = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--analysis-scale") && i + 1 < argc)
+            options.analysisScale = min(1.0, max(0.0, atof(argv[++i])));
+        else if (!strcmp(argv[i], "--live"))
+            options.live = true;
+        else if (!strcmp(argv[i], "--fps") && i + 1 < argc)
+            options.inputFps = max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--checkpoint-interval") && i + 1 < argc)
+            options.checkpointInterval = max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--resume"))
+            options.resume = true;
+        else if (!strcmp(argv[i], "--sampling-step") && i + 1 < argc)
+            options.samplingStep = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--channel") && i + 1 < argc)
+            options.channelName = argv[++i];
+        else if (!strcmp(argv[i], "--library") && i + 1 < argc)
+            options.libraryDirectory = argv[++i];
+        else if (!strcmp(argv[i], "--ad-index") && i + 1 < argc)
+            options.adIndexDirectory = argv[++i];
+        else if ((!strcmp(argv[i], "--backend") || !strcmp(argv[i], "--writer-backend")) && i + 1 < argc){
+            int backend = parseBackend(argv[i + 1]);
+
+            if (backend == -1)
+                cout << "Unknown backend " << argv[i + 1] << ", using any\n";
+            else if (!strcmp(argv[i], "--backend"))
+                options.videoOptions.backend = backend;
+            else
+                options.videoOptions.writerBackend = backend;
+            i++;
+        }
+        else if (!strcmp(argv[i], "--decoder-threads") && i + 1 < argc)
+            options.videoOptions.decoderThreads = max(0, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--buffer-size") && i + 1 < argc)
+            options.videoOptions.bufferSize = max(0, atoi(argv[++i]));
+        else if ((!strcmp(argv[i], "--capture-property") || !strcmp(argv[i], "--writer-property")) && i + 1 < argc){
+            int property = 0;
+            int value = 0;
+
+            if (sscanf(argv[i + 1], "%d=%d", &property, &value) != 2)
+                cout << "Property must be given as ID=VALUE, " << argv[i + 1] << " ignored\n";
+            else if (!strcmp(argv[i], "--capture-property")){
+                options.videoOptions.captureParameters.push_back(property);
+                options.videoOptions.captureParameters.push_back(value);
+            }
+            else {
+                options.videoOptions.writerParameters.push_back(property);
+                options.videoOptions.writerParameters.push_back(value);
+            }
+            i++;
+        }
+        else if (!strcmp(argv[i], "--trace") && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (!strcmp(argv[i], "--workers") && i + 1 < argc)
+            workerCount = max(1, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--output-dir") && i + 1 < argc)
+            outputRoot = argv[++i];
+        else if (!strcmp(argv[i], "--logo-grid") && i + 1 < argc){
+            if (sscanf(argv[++i], "%dx%d", &options.gridColumns, &options.gridRows) != 2 || options.gridColumns < 1 || options.gridRows < 1){
+                puts("Logo grid must be given as CxR (e.g. 7x5), using 7x5");
+                options.gridColumns = 7;
+                options.gridRows = 5;
+            }
+        }
+    }
 
-        writer.release();
+    // the recordings of a batch are files, each one analysed by a single worker
+    if (batch && options.live){
+        puts("Live inputs cannot be analysed in a batch, ignored");
+        options.live = false;
     }
 
-    json["logos"] = logoVec;
-    json["segments"] = segmentVec;
+    // a live input can be read only once, so frames are trimmed and written as they come
+    if (options.live && (options.chunkCount >= 0 || options.streamCopy)){
+        puts("Chunks and stream copy need a file, ignored with --live");
+        options.chunkCount = -1;
+        options.streamCopy = false;
+    }
 
+    if (options.live)
+        options.singlePass = true;
 
-    // writing thee json object
+    if (options.chunkCount == 0)
+        options.chunkCount = max(1, (int)thread::hardware_concurrency());
 
-    if (!json.empty()){
-        ofstream file;
-        file.open("json.json");
+    if (options.chunkCount > 0 || options.streamCopy)
+        options.pipeline = options.singlePass = false;
 
-        Json::StyledWriter jsonWriter;
-        file << jsonWriter.write(json);
+    // only the classification pass over the whole input can be continued, segments written on the way cannot
+    if ((options.checkpointInterval > 0 || options.resume) && (options.singlePass || options.chunkCount > 0)){
+        puts("Checkpoints need the classification pass of the default mode, ignored");
+        options.checkpointInterval = 0;
+        options.resume = false;
+    }
 
-        file.close();
+    if (!tracePath.empty()){
+        enableTracing();
+        nameTraceThread("main");
     }
 
-    delete channel;
-    vidCapture.release();
+    int failed = 0;
+
+    if (batch)
+        failed = analyzeBatch(argv[2], options, workerCount, outputRoot);
+    else if (!analyzeInput(argv[1], options, "").analysed)
+        failed = 1;
+
+    // every thread recording stages is done
+    if (!tracePath.empty() && writeTrace(tracePath))
+        cout << "Trace written to " << tracePath << "\n";
+
     cv::destroyAllWindows();
 
-    return 0;
-}
\ No newline at end of file
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,350 @@
+#include "streamcopy.hpp"
+#include <cstdio>
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <algorithm>
+
+using namespace camicasa;
+
+string camicasa::quoteArgument(string text)
+{
+    string quoted = "'";
+
+    for (int i = 0; i < text.size(); i++){
+        if (text[i] == '\'')
+            quoted += "'\\''";
+        else
+            quoted += text[i];
+    }
+
+    return quoted + "'";
+}
+
+/**
+    @brief Run a command and read what it prints
+    @param command shell command
+    @param[out] output lines printed by the command
+    @returns returns true if the command ran successfully
+*/
+static bool runCommand(string command, vector<string> &output)
+{
+    FILE *pipe = popen(command.c_str(), "r");
+
+    if (!pipe)
+        return false;
+
+    char line[256];
+    while (fgets(line, sizeof(line), pipe)){
+        string text = line;
+        text.erase(text.find_last_not_of(" \r\n,") + 1);
+        output.push_back(text);
+    }
+
+    return pclose(pipe) == 0;
+}
+
+/**
+    @brief Format a timestamp in milliseconds as seconds for ffmpeg
+    @param timestamp in milliseconds
+    @returns returns string with the format s.ms
+*/
+static string formatSeconds(int timestamp)
+{
+    char seconds[32];
+    snprintf(seconds, sizeof(seconds), "%.3f", timestamp / 1000.0);
+    return seconds;
+}
+
+/**
+    @brief Run ffmpeg over a range of the input
+    @param source path of the input
+    @param start start of the range in milliseconds
+    @param end end of the range in milliseconds
+    @param codecArguments ffmpeg arguments choosing how to encode the range
+    @param output path of the written video
+    @returns returns true if ffmpeg ran successfully
+*/
+static bool cutRange(string source, int start, int end, string codecArguments, string output)
+{
+    stringstream command;
+    command << "ffmpeg -y -v error -ss " << formatSeconds(start) << " -i " << quoteArgument(source)
+            << " -t " << formatSeconds(end - start) << " -map 0:v:0 -map 0:a? " << codecArguments << " " << quoteArgument(output);
+
+    return system(command.str().c_str()) == 0;
+}
+
+int camicasa::findStartTime(string source)
+{
+    vector<string> output;
+
+    string command = "ffprobe -v error -select_streams v:0 -show_entries stream=start_time -of csv=p=0 " + quoteArgument(source);
+
+    if (!runCommand(command, output) || output.empty() || output[0] == "N/A")
+        return 0;
+
+    return (int)round(atof(output[0].c_str()) * 1000);
+}
+
+vector<int> camicasa::findKeyframes(string source)
+{
+    vector<string> output;
+    vector<int> keyframes;
+
+    string command = "ffprobe -v error -select_streams v:0 -skip_frame nokey -show_entries frame=pts_time -of csv=p=0 " + quoteArgument(source);
+
+    if (!runCommand(command, output))
+        return keyframes;
+
+    // timestamps of ffprobe include the start of the stream
+    int startTime = findStartTime(source);
+
+    for (int i = 0; i < output.size(); i++)
+        if (!output[i].empty() && output[i] != "N/A")
+            keyframes.push_back((int)round(atof(output[i].c_str()) * 1000) - startTime);
+
+    sort(keyframes.begin(), keyframes.end());
+    return keyframes;
+}
+
+/**
+    @brief Read the key=value lines printed by ffprobe for a stream
+    @param source path of the input
+    @param stream stream selected (e.g. v:0)
+    @param entries entries shown
+    @param options optional ffprobe options (default is none)
+    @returns returns the values by key, empty if ffprobe failed
+*/
+static map<string, string> probeStream(string source, string stream, string entries, string options = "")
+{
+    vector<string> output;
+    map<string, string> values;
+
+    string command = "ffprobe -v error " + options + " -select_streams " + stream + " -show_entries stream=" + entries +
+                     " -of default=noprint_wrappers=1 " + quoteArgument(source);
+
+    if (!runCommand(command, output))
+        return values;
+
+    for (int i = 0; i < output.size(); i++){
+        size_t equals = output[i].find('=');
+        if (equals != string::npos && output[i].substr(equals + 1) != "N/A" && output[i].substr(equals + 1) != "unknown")
+            values[output[i].substr(0, equals)] = output[i].substr(equals + 1);
+    }
+
+    return values;
+}
+
+bool camicasa::probeStreams(string source, StreamParameters &parameters)
+{
+    map<string, string> video = probeStream(source, "v:0", "codec_name,profile,level,pix_fmt,r_frame_rate,time_base");
+    map<string, string> audio = probeStream(source, "a:0", "codec_name,sample_rate,channels,bit_rate");
+
+    parameters = StreamParameters();
+    parameters.videoCodec = video["codec_name"];
+    parameters.profile = video["profile"];
+    parameters.level = atoi(video["level"].c_str());
+    parameters.pixelFormat = video["pix_fmt"];
+    parameters.frameRate = video["r_frame_rate"];
+    parameters.timeBase = video["time_base"];
+    parameters.audioCodec = audio["codec_name"];
+    parameters.sampleRate = atoi(audio["sample_rate"].c_str());
+    parameters.channels = atoi(audio["channels"].c_str());
+    parameters.audioBitRate = atoi(audio["bit_rate"].c_str());
+
+    return !parameters.videoCodec.empty();
+}
+
+/**
+    @brief Find the name given to a profile by the encoder options, from the one reported by ffprobe
+    @param profile profile reported by ffprobe (e.g. Constrained Baseline, High 4:2:2)
+    @returns returns the profile for -profile:v (e.g. baseline, high422)
+*/
+static string encoderProfile(string profile)
+{
+    if (profile == "Constrained Baseline")
+        return "baseline";
+
+    string name;
+    for (int i = 0; i < profile.size(); i++)
+        if (isalnum(profile[i]))
+            name += tolower(profile[i]);
+
+    // High 4:4:4 Predictive
+    if (name.find("high444") == 0)
+        return "high444";
+
+    return name;
+}
+
+/**
+    @brief Build the ffmpeg arguments re-encoding the video as the input encodes it, so the parts can be joined to the copied one
+    @param encoder encoder of the codec of the input
+    @param parameters camicasa::StreamParameters of the input
+    @returns returns the arguments for the video
+*/
+static string videoArguments(string encoder, const StreamParameters &parameters)
+{
+    stringstream arguments;
+    arguments << "-c:v " << encoder;
+
+    if (!parameters.profile.empty() && (encoder == "libx264" || encoder == "libx265"))
+        arguments << " -profile:v " << encoderProfile(parameters.profile);
+
+    // ffprobe reports the level of H.264 times 10 and the one of HEVC times 30
+    if (parameters.level > 0 && encoder == "libx264")
+        arguments << " -level " << parameters.level / 10.0;
+    else if (parameters.level > 0 && encoder == "libx265")
+        arguments << " -x265-params level-idc=" << parameters.level / 30.0;
+
+    if (!parameters.pixelFormat.empty())
+        arguments << " -pix_fmt " << parameters.pixelFormat;
+
+    if (!parameters.frameRate.empty() && parameters.frameRate != "0/0")
+        arguments << " -r " << parameters.frameRate;
+
+    // the copied part keeps the time base of the input, e.g. 1/90000 on MPEG-TS
+    size_t slash = parameters.timeBase.find('/');
+    if (slash != string::npos && atoi(parameters.timeBase.c_str()) == 1)
+        arguments << " -video_track_timescale " << parameters.timeBase.substr(slash + 1);
+
+    return arguments.str();
+}
+
+/**
+    @brief Find the encoder of the audio codec of the input
+    @param codec audio codec reported by ffprobe
+    @returns returns the encoder, empty if there is no known one
+*/
+static string audioEncoder(string codec)
+{
+    if (codec == "aac" || codec == "mp2" || codec == "ac3" || codec == "eac3")
+        return codec;
+    if (codec == "mp3")
+        return "libmp3lame";
+
+    return "";
+}
+
+/**
+    @brief Build the ffmpeg arguments encoding the audio with the given encoder as the input has it
+    @param encoder audio encoder
+    @param parameters camicasa::StreamParameters of the input
+    @returns returns the arguments for the audio
+*/
+static string audioArguments(string encoder, const StreamParameters &parameters)
+{
+    stringstream arguments;
+    arguments << "-c:a " << encoder;
+
+    if (parameters.sampleRate > 0)
+        arguments << " -ar " << parameters.sampleRate;
+    if (parameters.channels > 0)
+        arguments << " -ac " << parameters.channels;
+    if (parameters.audioBitRate > 0)
+        arguments << " -b:a " << parameters.audioBitRate;
+
+    return arguments.str();
+}
+
+/**
+    @brief Check that a re-encoded part has the parameter sets of the copied one, as the concat demuxer keeps only those of
+    the first part (the SPS and PPS of H.264 and HEVC are in the extradata of an MP4)
+    @param part path of the re-encoded part
+    @param copied path of the copied part
+    @returns returns true if both parts were probed and have the same codec, profile, level, pixel format, size and extradata
+*/
+static bool sameParameterSets(string part, string copied)
+{
+    string entries = "codec_name,profile,level,pix_fmt,width,height,extradata_size,extradata_hash";
+
+    map<string, string> a = probeStream(part, "v:0", entries, "-show_data_hash CRC32");
+    map<string, string> b = probeStream(copied, "v:0", entries, "-show_data_hash CRC32");
+
+    return !a.empty() && a == b;
+}
+
+bool camicasa::copySegment(string source, const StreamParameters &parameters, vector<int> &keyframes, Segment segment, string output)
+{
+    // encoders producing streams that can be concatenated with the copied one
+    string codec = parameters.videoCodec;
+    string encoder;
+    if (codec == "h264")
+        encoder = "libx264";
+    else if (codec == "hevc")
+        encoder = "libx265";
+    else if (codec == "mpeg2video" || codec == "mpeg4")
+        encoder = codec;
+
+    // audio without a known encoder is re-encoded in every part, the copied one too, so all of them have the same
+    string audio = audioEncoder(parameters.audioCodec);
+    string copyAudio = audio.empty() ? audioArguments("aac", parameters) : string("-c:a copy");
+    string reencodeAudio = audio.empty() ? audioArguments("aac", parameters) : audioArguments(audio, parameters);
+
+    string reencode = (encoder.empty() ? string("-c:v libx264") : videoArguments(encoder, parameters)) + " " + reencodeAudio;
+
+    // first keyframe at or after the start and last keyframe at or before the end
+    vector<int>::iterator first = lower_bound(keyframes.begin(), keyframes.end(), segment.startTimestamp);
+    vector<int>::iterator last = upper_bound(keyframes.begin(), keyframes.end(), segment.endTimestamp);
+
+    if (encoder.empty() || first == keyframes.end() || last == keyframes.begin() || *first >= *(last - 1))
+        return cutRange(source, segment.startTimestamp, segment.endTimestamp, reencode, output);
+
+    int copyStart = *first;
+    int copyEnd = *(last - 1);
+
+    vector<string> parts;
+    bool success = true;
+
+    if (copyStart > segment.startTimestamp){
+        parts.push_back(output + ".head.mp4");
+        success = success && cutRange(source, segment.startTimestamp, copyStart, reencode, parts.back());
+    }
+
+    string body = output + ".body.mp4";
+    parts.push_back(body);
+    success = success && cutRange(source, copyStart, copyEnd, "-c:v copy " + copyAudio + " -avoid_negative_ts make_zero", body);
+
+    if (segment.endTimestamp > copyEnd){
+        parts.push_back(output + ".tail.mp4");
+        success = success && cutRange(source, copyEnd, segment.endTimestamp, reencode, parts.back());
+    }
+
+    // parts with other parameter sets would be joined into a stream that does not decode, so the whole segment is re-encoded
+    bool joinable = true;
+    for (int i = 0; success && joinable && i < parts.size(); i++)
+        if (parts[i] != body)
+            joinable = sameParameterSets(parts[i], body);
+
+    if (success && !joinable){
+        for (int i = 0; i < parts.size(); i++)
+            remove(parts[i].c_str());
+
+        return cutRange(source, segment.startTimestamp, segment.endTimestamp, reencode, output);
+    }
+
+    string list = output + ".txt";
+
+    if (success){
+        FILE *file = fopen(list.c_str(), "w");
+        success = file != NULL;
+
+        // the concat demuxer looks for the parts next to the list
+        for (int i = 0; success && i < parts.size(); i++)
+            fprintf(file, "file %s\n", quoteArgument(parts[i].substr(parts[i].find_last_of('/') + 1)).c_str());
+
+        if (file)
+            fclose(file);
+    }
+
+    if (success){
+        string command = "ffmpeg -y -v error -f concat -safe 0 -i " + quoteArgument(list) + " -c copy " + quoteArgument(output);
+        success = system(command.c_str()) == 0;
+    }
+
+    remove(list.c_str());
+    for (int i = 0; i < parts.size(); i++)
+        remove(parts[i].c_str());
+
+    return success;
+}
@@ -0,0 +1,81 @@
+#ifndef _STREAMCOPY_
+#define _STREAMCOPY_
+
+#include <string>
+#include <vector>
+#include "utils.hpp"
+
+using namespace std;
+
+namespace camicasa
+{
+
+    /**
+        @brief The function camicasa::quoteArgument quotes a string for the shell
+        @param text string to quote
+        @returns returns the string between single quotes
+    */
+    string quoteArgument(string text);
+
+    /// @brief struct camicasa::StreamParameters with how the first video and audio streams of an input are encoded, as reported by ffprobe
+    struct StreamParameters {
+        /// @brief codec of the video (e.g. h264), empty if ffprobe failed
+        string videoCodec;
+        /// @brief profile, level and pixel format of the video (e.g. High, 40 and yuv420p)
+        string profile;
+        int level = 0;
+        string pixelFormat;
+        /// @brief frame rate (e.g. 30000/1001) and time base (e.g. 1/90000) of the video
+        string frameRate;
+        string timeBase;
+        /// @brief codec of the audio (e.g. mp2), empty if the input has no audio
+        string audioCodec;
+        int sampleRate = 0;
+        int channels = 0;
+        int audioBitRate = 0;
+    };
+
+    /**
+        @brief The function camicasa::findStartTime finds when the first video stream of the input starts, which is not 0 on 
+        MPEG-TS and other broadcast captures
+        @param source path of the input
+        @returns returns the start time in milliseconds, 0 if ffprobe failed
+        @note ffmpeg -ss and cv::CAP_PROP_POS_MSEC count from this start, while the timestamps of ffprobe include it
+    */
+    int findStartTime(string source);
+
+    /**
+        @brief The function camicasa::findKeyframes lists the keyframes of the first video stream of the input using ffprobe
+        @param source path of the input
+        @returns returns the sorted timestamps of the keyframes in milliseconds from the start of the stream (empty if ffprobe failed)
+    */
+    vector<int> findKeyframes(string source);
+
+    /**
+        @brief The function camicasa::probeStreams finds how the first video and audio streams of the input are encoded using ffprobe
+        @param source path of the input
+        @param[out] parameters camicasa::StreamParameters of the input
+        @returns returns true if the input has a video stream
+    */
+    bool probeStreams(string source, StreamParameters &parameters);
+
+    /**
+        @brief The function camicasa::copySegment cuts a segment straight from the input container using ffmpeg, copying the
+        stream between the first and last keyframes inside the segment and re-encoding only the frames before and after them
+        @param source path of the input
+        @param parameters camicasa::StreamParameters of the input as given by camicasa::probeStreams()
+        @param keyframes keyframes of the input as given by camicasa::findKeyframes()
+        @param segment camicasa::Segment to cut
+        @param output path of the written video
+        @returns returns true if the segment was written
+        @note If the codec has no known encoder or there are no keyframes inside the segment, the whole segment is re-encoded.
+        The re-encoded parts keep the profile, level, pixel format, frame rate, time base and audio codec of the input so they
+        can be joined to the copied one, and if the audio codec has no known encoder the audio of every part is re-encoded.
+        If a re-encoded part still ends up with other parameter sets (codec, profile, level, pixel format, size or extradata)
+        than the copied one, the whole segment is re-encoded
+    */
+    bool copySegment(string source, const StreamParameters &parameters, vector<int> &keyframes, Segment segment, string output);
+
+}
+
+#endif
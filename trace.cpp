@@ -0,0 +1,161 @@
+#include "trace.hpp"
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <fstream>
+
+using namespace camicasa;
+
+atomic<bool> camicasa::tracingEnabled(false);
+
+/// @brief struct TraceBuffer with the ring buffer of stages of a thread
+struct TraceBuffer {
+    int threadId;
+    string threadName;
+    vector<TraceEvent> events;
+    /// @brief number of stages recorded, the next one going to events[recorded % events.size()]
+    size_t recorded = 0;
+    /// @brief true once its thread ended, the buffer then only holding the stages it recorded
+    bool finished = false;
+};
+
+/// @brief buffers of all the threads that recorded stages, kept until the trace is written as threads may end before
+static vector<TraceBuffer*> traceBuffers;
+static mutex traceBuffersMutex;
+static int traceCapacity = 65536;
+static int nextThreadId = 1;
+static chrono::steady_clock::time_point traceStart;
+
+/// @brief struct ThreadTrace owning the buffer of a thread, trimming it to the recorded stages when the thread ends
+struct ThreadTrace {
+    TraceBuffer *buffer = NULL;
+
+    ~ThreadTrace() {
+        if (this->buffer == NULL)
+            return;
+
+        lock_guard<mutex> lock(traceBuffersMutex);
+
+        // the ring is only needed while recording, so keep its stages oldest first and free the rest
+        size_t size = this->buffer->events.size();
+        size_t oldest = (this->buffer->recorded > size) ? this->buffer->recorded - size : 0;
+
+        vector<TraceEvent> events;
+        events.reserve(this->buffer->recorded - oldest);
+        for (size_t i = oldest; i < this->buffer->recorded; i++)
+            events.push_back(this->buffer->events[i % size]);
+
+        this->buffer->events.swap(events);
+        this->buffer->recorded = this->buffer->events.size();
+        this->buffer->finished = true;
+    }
+};
+
+/// @returns returns the buffer of the calling thread, registering it on its first stage
+static TraceBuffer* threadBuffer()
+{
+    static thread_local ThreadTrace thread;
+
+    if (thread.buffer == NULL){
+        lock_guard<mutex> lock(traceBuffersMutex);
+
+        thread.buffer = new TraceBuffer();
+        thread.buffer->threadId = nextThreadId++;
+        thread.buffer->events.resize(traceCapacity);
+        traceBuffers.push_back(thread.buffer);
+    }
+
+    return thread.buffer;
+}
+
+void camicasa::enableTracing(int capacity)
+{
+    traceCapacity = max(1, capacity);
+    traceStart = chrono::steady_clock::now();
+    tracingEnabled = true;
+}
+
+void camicasa::nameTraceThread(string name)
+{
+    if (isTracing())
+        threadBuffer()->threadName = name;
+}
+
+int64_t camicasa::traceClock()
+{
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - traceStart).count();
+}
+
+void camicasa::recordTrace(const TraceEvent &event)
+{
+    TraceBuffer *buffer = threadBuffer();
+
+    buffer->events[buffer->recorded % buffer->events.size()] = event;
+    buffer->recorded++;
+}
+
+bool camicasa::writeTrace(string path)
+{
+    lock_guard<mutex> lock(traceBuffersMutex);
+
+    ofstream file(path, ios::trunc);
+    if (!file.is_open()){
+        puts("Error writing trace");
+        return false;
+    }
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+
+    bool first = true;
+
+    for (int i = 0; i < traceBuffers.size(); i++){
+        TraceBuffer *buffer = traceBuffers[i];
+
+        if (!buffer->threadName.empty()){
+            file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+            first = false;
+        }
+
+        // a full ring buffer starts at its oldest stage
+        size_t size = buffer->events.size();
+        size_t oldest = (buffer->recorded > size) ? buffer->recorded - size : 0;
+
+        for (size_t j = oldest; j < buffer->recorded; j++){
+            TraceEvent &event = buffer->events[j % size];
+
+            file << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << event.start << ",\"dur\":" << event.duration << ",\"args\":{";
+
+            bool firstArgument = true;
+            if (event.segmentId != -1){
+                file << "\"segment\":" << event.segmentId;
+                firstArgument = false;
+            }
+            if (event.segmentType != NULL){
+                file << (firstArgument ? "" : ",") << "\"type\":\"" << event.segmentType << "\"";
+                firstArgument = false;
+            }
+            if (event.logoId != -1)
+                file << (firstArgument ? "" : ",") << "\"logo\":" << event.logoId;
+
+            file << "}}";
+            first = false;
+        }
+    }
+
+    file << "\n]}\n";
+    file.close();
+
+    // the stages of the threads that ended are written, so their buffers are freed
+    size_t kept = 0;
+    for (size_t i = 0; i < traceBuffers.size(); i++){
+        if (traceBuffers[i]->finished)
+            delete traceBuffers[i];
+        else
+            traceBuffers[kept++] = traceBuffers[i];
+    }
+    traceBuffers.resize(kept);
+
+    return !file.fail();
+}
@@ -0,0 +1,112 @@
+#ifndef _TRACE_
+#define _TRACE_
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+namespace camicasa
+{
+
+    /// @brief struct camicasa::TraceEvent containing a stage timed by camicasa::ScopedTrace, with the segment it worked on
+    struct TraceEvent {
+        /// @brief name of the stage, a string literal
+        const char *name = NULL;
+        /// @brief start of the stage in microseconds since tracing was enabled
+        int64_t start = 0;
+        /// @brief duration of the stage in microseconds
+        int64_t duration = 0;
+        /// @brief annotations, -1 or NULL when unknown
+        int segmentId = -1;
+        const char *segmentType = NULL;
+        int logoId = -1;
+    };
+
+    /// @brief flag read by every camicasa::ScopedTrace, so a disabled trace costs a single load
+    extern atomic<bool> tracingEnabled;
+
+    /**
+        @brief The function camicasa::enableTracing starts recording the stages timed by camicasa::ScopedTrace
+        @param capacity optional number of stages kept by each thread, the oldest ones being overwritten (default is 65536)
+    */
+    void enableTracing(int capacity = 65536);
+
+    /// @returns returns true if the stages are being recorded
+    inline bool isTracing() {
+        return tracingEnabled.load(memory_order_relaxed);
+    }
+
+    /**
+        @brief The function camicasa::nameTraceThread names the calling thread in the trace
+        @param name name of the thread (e.g. decoder)
+    */
+    void nameTraceThread(string name);
+
+    /**
+        @brief The function camicasa::recordTrace adds a stage to the ring buffer of the calling thread
+        @param event camicasa::TraceEvent to add
+    */
+    void recordTrace(const TraceEvent &event);
+
+    /// @returns returns the microseconds since tracing was enabled
+    int64_t traceClock();
+
+    /**
+        @brief The function camicasa::writeTrace writes the stages recorded by all threads as a Chrome trace (JSON object format),
+        which chrome://tracing and Perfetto open
+        @param path path of the trace
+        @returns returns true if the trace was written
+        @note Must be called once the threads recording stages are done
+    */
+    bool writeTrace(string path);
+
+    /**
+        @brief class camicasa::ScopedTrace timing a stage from its construction to its destruction
+        @note Nothing is read nor written when tracing is disabled besides camicasa::tracingEnabled
+    */
+    class ScopedTrace {
+    private:
+        /// @brief stage being timed, with a NULL name when tracing is disabled
+        TraceEvent event;
+
+    public:
+        /**
+            @brief constructor of class camicasa::ScopedTrace
+            @param name name of the stage, a string literal
+        */
+        ScopedTrace(const char *name) {
+            if (!isTracing())
+                return;
+
+            this->event.name = name;
+            this->event.start = traceClock();
+        }
+
+        /// @brief destructor of class camicasa::ScopedTrace, recording the stage
+        ~ScopedTrace() {
+            if (this->event.name == NULL)
+                return;
+
+            this->event.duration = traceClock() - this->event.start;
+            recordTrace(this->event);
+        }
+
+        /**
+            @brief The function camicasa::ScopedTrace::annotate tells which segment and logo the stage worked on
+            @param segmentId identifier of the segment
+            @param segmentType type of the segment as a string literal (e.g. given by camicasa::stringifyTVChannelType)
+            @param logoId optional identifier of the logo (default is -1)
+        */
+        void annotate(int segmentId, const char *segmentType, int logoId = -1) {
+            this->event.segmentId = segmentId;
+            this->event.segmentType = segmentType;
+            this->event.logoId = logoId;
+        }
+    };
+
+}
+
+#endif
@@ -1,4 +1,12 @@
 #include "utils.hpp"
+#include "adindex.hpp"
+#include "trace.hpp"
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
 
 using namespace camicasa;
 
@@ -7,8 +15,22 @@ camicasa::TVChannel::TVChannel(int frameWidth,  int frameHeight, int fps, int mi
     this->frameHeight = frameHeight;
     this->fps = fps;
     this->minimumTime = minimumTime;
-    this->frameStillCount = {0, 0, 0, 0};
+    this->blackFrameStride = 1;
+    this->analysisScale = 0;
+    this->gridColumns = 7;
+    this->gridRows = 5;
+    this->cornerLogos.resize(NONE + 1);
+    this->cornerLogoBounds.resize(NONE + 1);
+    this->alreadyBlack = false;
+    this->startSegment = false;
+    this->logoAlreadyFound = false;
+    this->resetOperationBitwise = false;
+    this->adIndex = NULL;
+    this->learnAds = false;
+    // buffers are only allocated on first use, so copies of a channel not used yet do not share them
+    this->cornerEdges.resize(NONE + 1);
     this->populateCorners(); 
+    this->populateTiles();
 }
 
 camicasa::TVChannel::~TVChannel() {
@@ -44,6 +66,55 @@ void camicasa::TVChannel::populateCorners(){
     this->corners.push_back(Point(w, y));
     this->corners.push_back(Point(x, z));
     this->corners.push_back(Point(w, z));
+
+    this->cornerRegions.push_back(Rect(0, 0, x, y));
+    this->cornerRegions.push_back(Rect(frameWidth - w, 0, w, y));
+    this->cornerRegions.push_back(Rect(0, frameHeight - z, x, z));
+    this->cornerRegions.push_back(Rect(frameWidth - w, frameHeight - z, w, z));
+}
+
+void camicasa::TVChannel::populateTiles(){
+    this->tileColumns.clear();
+    this->tileRows.clear();
+
+    for (int column = 0; column <= this->gridColumns; column++)
+        this->tileColumns.push_back(column * this->frameWidth / this->gridColumns);
+
+    for (int row = 0; row <= this->gridRows; row++)
+        this->tileRows.push_back(row * this->frameHeight / this->gridRows);
+
+    this->tileAreas.create(this->gridRows, this->gridColumns, CV_32S);
+    this->tileIgnored.create(this->gridRows, this->gridColumns, CV_8U);
+
+    for (int row = 0; row < this->gridRows; row++){
+        for (int column = 0; column < this->gridColumns; column++){
+            int width = this->tileColumns[column + 1] - this->tileColumns[column];
+            int height = this->tileRows[row + 1] - this->tileRows[row];
+            bool edge = (row == 0 || row == this->gridRows - 1 || column == 0 || column == this->gridColumns - 1);
+
+            this->tileAreas.at<int>(row, column) = width * height;
+            this->tileIgnored.at<uchar>(row, column) = edge ? 0 : 255;
+        }
+    }
+
+    this->frameStillCount.assign(this->gridColumns * this->gridRows, 0);
+}
+
+void camicasa::TVChannel::setLogoGrid(int columns, int rows){
+    this->gridColumns = max(1, columns);
+    this->gridRows = max(1, rows);
+    this->populateTiles();
+}
+
+vector<Rect> camicasa::TVChannel::getTiles(){
+    vector<Rect> tiles;
+
+    for (int row = 0; row < this->gridRows; row++)
+        for (int column = 0; column < this->gridColumns; column++)
+            tiles.push_back(Rect(this->tileColumns[column], this->tileRows[row],
+                                 this->tileColumns[column + 1] - this->tileColumns[column], this->tileRows[row + 1] - this->tileRows[row]));
+
+    return tiles;
 }
 
 void camicasa::TVChannel::addSegment(Segment segment){
@@ -52,6 +123,28 @@ void camicasa::TVChannel::addSegment(Segment segment){
 
 void camicasa::TVChannel::addLogo(Logo logo)
 {
+    // the image may be a region of a frame that keeps changing
+    logo.image = logo.image.clone();
+
+    if (logo.edges.empty())
+        computeLogoEdges(logo.image, logo.edges);
+    else
+        logo.edges = logo.edges.clone();
+
+    computeEdgeCells(logo.edges, logo.edgeCells, logo.edgeHash);
+
+    this->currentLogo.id = max(this->currentLogo.id, logo.id + 1);
+
+    // group the logo with the first corner region containing it
+    Rect area(logo.x, logo.y, logo.width, logo.height);
+    int corner = TOP_LEFT;
+
+    while (corner < NONE && (area & this->cornerRegions[corner]) != area)
+        corner++;
+
+    this->cornerLogoBounds[corner] = this->cornerLogos[corner].empty() ? area : (this->cornerLogoBounds[corner] | area);
+    this->cornerLogos[corner].push_back(this->logos.size());
+
     this->logos.push_back(logo);
 }
 
@@ -68,12 +161,111 @@ vector<Segment> camicasa::TVChannel::getSegments() {
     return this->segments;
 }
 
-vector<Logo> camicasa::TVChannel::getLogos() {
+const vector<Logo>& camicasa::TVChannel::getLogos() {
     return this->logos;
 }
 
-bool camicasa::screenThresholdDetection(Mat &frame, ComparisonOperation operation /*CHECK_SMALLER*/, int threshold /*1*/)
+Segment camicasa::TVChannel::getCurrentSegment() {
+    return this->currentSegment;
+}
+
+bool camicasa::TVChannel::isSegmentOpen() {
+    return this->startSegment;
+}
+
+void camicasa::TVChannel::setBlackFrameStride(int stride) {
+    this->blackFrameStride = max(1, stride);
+}
+
+void camicasa::TVChannel::setAnalysisScale(double scale) {
+    Size size = analysisSize(Size(this->frameWidth, this->frameHeight), scale);
+
+    this->analysisScale = max(0.0, scale);
+    this->frameWidth = size.width;
+    this->frameHeight = size.height;
+
+    this->corners.clear();
+    this->cornerRegions.clear();
+    this->populateCorners();
+    this->populateTiles();
+}
+
+double camicasa::TVChannel::getAnalysisScale() {
+    return this->analysisScale;
+}
+
+/**
+    @brief Sum the bytes of a row
+    @param data first byte of the row
+    @param length number of bytes
+    @returns returns the sum of all bytes
+*/
+static uint64_t sumBytes(const uchar *data, int length)
+{
+    uint64_t sum = 0;
+    int i = 0;
+
+#if defined(__AVX2__)
+    __m256i zero = _mm256_setzero_si256();
+    __m256i accumulator = _mm256_setzero_si256();
+
+    // sum of absolute differences against zero adds up each 8 bytes in a 64-bit lane
+    for (; i + 32 <= length; i += 32)
+        accumulator = _mm256_add_epi64(accumulator, _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(data + i)), zero));
+
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i*)lanes, accumulator);
+    sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(__SSE2__)
+    __m128i zero = _mm_setzero_si128();
+    __m128i accumulator = _mm_setzero_si128();
+
+    for (; i + 16 <= length; i += 16)
+        accumulator = _mm_add_epi64(accumulator, _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(data + i)), zero));
+
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i*)lanes, accumulator);
+    sum = lanes[0] + lanes[1];
+#elif defined(__ARM_NEON)
+    uint32x4_t accumulator = vdupq_n_u32(0);
+
+    // pairwise widening adds, a row is far from overflowing the 32-bit lanes
+    for (; i + 16 <= length; i += 16)
+        accumulator = vpadalq_u16(accumulator, vpaddlq_u8(vld1q_u8(data + i)));
+
+    sum = (uint64_t)vgetq_lane_u32(accumulator, 0) + vgetq_lane_u32(accumulator, 1) + vgetq_lane_u32(accumulator, 2) + vgetq_lane_u32(accumulator, 3);
+#endif
+
+    for (; i < length; i++)
+        sum += data[i];
+
+    return sum;
+}
+
+bool camicasa::screenThresholdDetection(Mat &frame, ComparisonOperation operation /*CHECK_SMALLER*/, int threshold /*1*/, int stride /*1*/)
 {
+    if (!frame.empty() && frame.depth() == CV_8U && (frame.channels() == 1 || frame.channels() == 3))
+    {
+        stride = max(1, stride);
+
+        int length = frame.cols * frame.channels();
+        int rows = (frame.rows + stride - 1) / stride;
+
+        // the integer average is under/above the threshold exactly when the sum is under/above this bound
+        int factor = max(0, (operation == CHECK_SMALLER) ? threshold + 1 : threshold);
+        uint64_t bound = (uint64_t)factor * rows * length;
+
+        // stop as soon as the sum reaches the bound, the rows left can only increase it
+        uint64_t sum = 0;
+        for (int row = 0; row < frame.rows && sum < bound; row += stride)
+            sum += sumBytes(frame.ptr<uchar>(row), length);
+
+        if (operation == CHECK_SMALLER)
+            return (sum < bound);
+
+        return (sum >= bound);
+    }
+
     Scalar mean = cv::mean(frame);
 
     int avg = (mean(0) + mean(1) + mean(2)) / (frame.channels());
@@ -84,58 +276,186 @@ bool camicasa::screenThresholdDetection(Mat &frame, ComparisonOperation operatio
     return (avg >= threshold);
 }
 
-void camicasa::TVChannel::checkForSaturatedCorners(Mat &frame, ComparisonOperation operation /*CHECK_SMALLER*/, int threshold /*1*/)
-{
-    // get the four cropped frames representing the corners
+template <typename T>
+double camicasa::RegionStatistics::sumArea(const Mat &integral, Rect area) {
+    const T *top = integral.ptr<T>(area.y);
+    const T *bottom = integral.ptr<T>(area.y + area.height);
 
-    Mat topLeft = frame(Range(0, this->corners.at(TOP_LEFT).y), Range(0, this->corners.at(TOP_LEFT).x));
-    Mat topRight = frame(Range(0, this->corners.at(TOP_RIGHT).y), Range(this->frameWidth - this->corners.at(TOP_RIGHT).x, this->frameWidth));
-    Mat bottomLeft = frame(Range(this->frameHeight - this->corners.at(BOTTOM_LEFT).y, this->frameHeight), Range(0, this->corners.at(BOTTOM_LEFT).x));
-    Mat bottomRight = frame(Range(0, this->corners.at(BOTTOM_RIGHT).y), Range(this->frameWidth - this->corners.at(BOTTOM_RIGHT).x, this->frameWidth));
+    int left = area.x * this->channels;
+    int right = (area.x + area.width) * this->channels;
 
-    this->frameStillCount[TOP_LEFT] = (screenThresholdDetection(topLeft, operation, threshold)) ? 0 : this->frameStillCount[TOP_LEFT] + 1;
-    this->frameStillCount[TOP_RIGHT] = (screenThresholdDetection(topRight, operation, threshold)) ? 0 : this->frameStillCount[TOP_RIGHT] + 1;
-    this->frameStillCount[BOTTOM_LEFT] = (screenThresholdDetection(bottomLeft, operation, threshold)) ? 0 : this->frameStillCount[BOTTOM_LEFT] + 1;
-    this->frameStillCount[BOTTOM_RIGHT] = (screenThresholdDetection(bottomRight, operation, threshold)) ? 0 : this->frameStillCount[BOTTOM_RIGHT] + 1;
+    // exact for integers, which the sums of several channels may not fit in
+    double sum = 0;
+    for (int c = 0; c < this->channels; c++)
+        sum += (double)bottom[right + c] - bottom[left + c] - top[right + c] + top[left + c];
+
+    return sum;
 }
 
-void camicasa::TVChannel::findLogo(Mat& inputOriginal, Mat& inputBitwise, Logo& logo){
-    Mat croppedOriginal;
-    Mat croppedBitwise;
-    ScreenCorner corner = NONE;
-    
-    if (this->frameStillCount[TOP_LEFT] >= this->minimumTime)
-    {
-        corner = TOP_LEFT;
-        croppedOriginal = inputOriginal(Range(0, this->corners.at(corner).y), Range(0, this->corners.at(corner).x));
-        croppedBitwise = inputBitwise(Range(0, this->corners.at(corner).y), Range(0, this->corners.at(corner).x));    
-    }
-    else if (this->frameStillCount[1] >= this->minimumTime)
-    {
-        corner = TOP_RIGHT;
-        croppedOriginal = inputOriginal(Range(0, this->corners.at(corner).y), Range(this->frameWidth - this->corners.at(corner).x, this->frameWidth));
-        croppedBitwise = inputBitwise(Range(0, this->corners.at(corner).y), Range(this->frameWidth - this->corners.at(corner).x, this->frameWidth));
-    }
-    else if (this->frameStillCount[BOTTOM_LEFT] >= this->minimumTime)
-    {
-        corner = BOTTOM_LEFT;
-        croppedOriginal = inputOriginal(Range(this->frameHeight - this->corners.at(corner).y, this->frameHeight), Range(0, this->corners.at(corner).x));
-        croppedBitwise = inputBitwise(Range(this->frameHeight - this->corners.at(corner).y, this->frameHeight), Range(0, this->corners.at(corner).x));
+void camicasa::RegionStatistics::compute(const Mat &frame, bool squares /*true*/) {
+    this->channels = frame.channels();
+
+    if (squares)
+        integral(frame, this->sums, this->squareSums, CV_32S, CV_64F);
+    else {
+        integral(frame, this->sums, CV_32S);
+        this->squareSums.release();
     }
-    else if (this->frameStillCount[BOTTOM_RIGHT] >= this->minimumTime)
-    {
-        corner = BOTTOM_RIGHT;
-        croppedOriginal = inputOriginal(Range(this->frameHeight - this->corners.at(corner).y, this->frameHeight), Range(this->frameWidth - this->corners.at(corner).x, this->frameWidth));
-        croppedBitwise = inputBitwise(Range(this->frameHeight - this->corners.at(corner).y, this->frameHeight), Range(this->frameWidth - this->corners.at(corner).x, this->frameWidth));
+}
+
+bool camicasa::RegionStatistics::empty() {
+    return this->sums.empty();
+}
+
+double camicasa::RegionStatistics::mean(Rect area) {
+    area = area & Rect(0, 0, this->sums.cols - 1, this->sums.rows - 1);
+
+    if (area.empty())
+        return 0;
+
+    return this->sumArea<int>(this->sums, area) / ((double)area.area() * this->channels);
+}
+
+double camicasa::RegionStatistics::variance(Rect area) {
+    area = area & Rect(0, 0, this->sums.cols - 1, this->sums.rows - 1);
+
+    if (area.empty() || this->squareSums.empty())
+        return 0;
+
+    double count = (double)area.area() * this->channels;
+    double mean = this->sumArea<int>(this->sums, area) / count;
+
+    return max(0.0, this->sumArea<double>(this->squareSums, area) / count - mean * mean);
+}
+
+bool camicasa::RegionStatistics::thresholdDetection(Rect area, ComparisonOperation operation /*CHECK_SMALLER*/, int threshold /*1*/) {
+    area = area & Rect(0, 0, this->sums.cols - 1, this->sums.rows - 1);
+
+    // the integer average is under/above the threshold exactly when the sum is under/above this bound
+    int64_t factor = max(0, (operation == CHECK_SMALLER) ? threshold + 1 : threshold);
+    int64_t bound = factor * area.area() * this->channels;
+    int64_t sum = area.empty() ? 0 : (int64_t)this->sumArea<int>(this->sums, area);
+
+    if (operation == CHECK_SMALLER)
+        return (sum < bound);
+
+    return (sum >= bound);
+}
+
+void camicasa::RegionStatistics::gridSums(const vector<int> &columns, const vector<int> &rows, Mat &sums) {
+    this->gridSamples.create(rows.size(), columns.size(), CV_32S);
+
+    for (int i = 0; i < rows.size(); i++){
+        const int *integralRow = this->sums.ptr<int>(rows[i]);
+        int *samples = this->gridSamples.ptr<int>(i);
+
+        for (int j = 0; j < columns.size(); j++){
+            samples[j] = 0;
+            for (int c = 0; c < this->channels; c++)
+                samples[j] += integralRow[columns[j] * this->channels + c];
+        }
     }
 
-    logo.screenCorner = corner;
-    
-    // no logo found
-    if (corner == NONE)
+    int tileRows = rows.size() - 1;
+    int tileColumns = columns.size() - 1;
+
+    // bottom right - top right - bottom left + top left, for all the tiles at once
+    subtract(this->gridSamples(Range(1, tileRows + 1), Range(1, tileColumns + 1)), this->gridSamples(Range(0, tileRows), Range(1, tileColumns + 1)), sums);
+    subtract(sums, this->gridSamples(Range(1, tileRows + 1), Range(0, tileColumns)), sums);
+    add(sums, this->gridSamples(Range(0, tileRows), Range(0, tileColumns)), sums);
+}
+
+void camicasa::TVChannel::checkForSaturatedTiles(Mat &frame, ComparisonOperation operation /*CHECK_SMALLER*/, int threshold /*1*/)
+{
+    // a single pass over the frame answers every tile
+    this->regionStatistics.compute(frame, false);
+    this->regionStatistics.gridSums(this->tileColumns, this->tileRows, this->tileSums);
+
+    // the integer average is under/above the threshold exactly when the sum is under/above this bound
+    int factor = max(0, (operation == CHECK_SMALLER) ? threshold + 1 : threshold);
+    multiply(this->tileAreas, Scalar(factor), this->tileBounds);
+    compare(this->tileSums, this->tileBounds, this->tileReset, (operation == CHECK_SMALLER) ? CMP_LT : CMP_GE);
+
+    // the inner tiles never count
+    bitwise_or(this->tileReset, this->tileIgnored, this->tileReset);
+
+    // the counters are updated in place through a header over them
+    Mat stillCount(this->gridRows, this->gridColumns, CV_32S, this->frameStillCount.data());
+    add(stillCount, Scalar(1), stillCount);
+    stillCount.setTo(Scalar(0), this->tileReset);
+}
+
+/**
+    @brief Find the corner of the screen an area is closest to
+    @param area area of the screen
+    @param frameWidth number of horizontal pixels of the screen
+    @param frameHeight number of vertical pixels of the screen
+    @returns returns the camicasa::ScreenCorner of the quarter of the screen with the center of the area
+*/
+static ScreenCorner nearestCorner(Rect area, int frameWidth, int frameHeight)
+{
+    bool right = 2 * area.x + area.width > frameWidth;
+    bool bottom = 2 * area.y + area.height > frameHeight;
+
+    if (bottom)
+        return right ? BOTTOM_RIGHT : BOTTOM_LEFT;
+
+    return right ? TOP_RIGHT : TOP_LEFT;
+}
+
+void camicasa::TVChannel::findLogos(Mat& inputOriginal, Mat& inputBitwise, vector<Logo>& logos){
+    ScopedTrace trace("findLogos");
+
+    logos.clear();
+
+    Mat stillCount(this->gridRows, this->gridColumns, CV_32S, this->frameStillCount.data());
+    compare(stillCount, Scalar(this->minimumTime), this->tileStill, CMP_GE);
+
+    if (!countNonZero(this->tileStill))
         return;
 
-    cropLogo(croppedOriginal, croppedBitwise, logo);
+    // neighbouring still tiles are cropped together
+    int groups = connectedComponents(this->tileStill, this->tileLabels, 4, CV_32S);
+
+    for (int group = 1; group < groups; group++)
+    {
+        Rect tiles;
+        bool empty = true;
+
+        for (int row = 0; row < this->gridRows; row++){
+            for (int column = 0; column < this->gridColumns; column++){
+                if (this->tileLabels.at<int>(row, column) != group)
+                    continue;
+
+                tiles = empty ? Rect(column, row, 1, 1) : (tiles | Rect(column, row, 1, 1));
+                empty = false;
+            }
+        }
+
+        Rect area(this->tileColumns[tiles.x], this->tileRows[tiles.y], 
+                  this->tileColumns[tiles.x + tiles.width] - this->tileColumns[tiles.x], this->tileRows[tiles.y + tiles.height] - this->tileRows[tiles.y]);
+
+        // grids finer than the frame have tiles without pixels
+        if (area.empty())
+            continue;
+
+        Mat croppedOriginal = inputOriginal(area);
+        Mat croppedBitwise = inputBitwise(area);
+
+        vector<Logo> extracted;
+        extractLogos(croppedOriginal, croppedBitwise, extracted);
+
+        for (int i = 0; i < extracted.size(); i++){
+            Logo logo = extracted[i];
+
+            // extractLogos answers in the coordinates of the cropped area
+            logo.x += area.x;
+            logo.y += area.y;
+            logo.screenCorner = nearestCorner(Rect(logo.x, logo.y, logo.width, logo.height), this->frameWidth, this->frameHeight);
+
+            logos.push_back(logo);
+        }
+    }
 }
 
 bool camicasa::TVChannel::hasStillFrames(){
@@ -151,37 +471,79 @@ bool camicasa::TVChannel::hasMinimumTimePassed(int time){
     return time >= this->minimumTime;
 }
 
-bool camicasa::TVChannel::findPatternLogo(Mat &input, Logo& pattern)
+bool camicasa::TVChannel::findPatternLogo(Mat &input, const Logo& pattern)
 {
     // crop the same area as the pattern
     Mat cropped;
     cropped = input(Range(pattern.y, pattern.y + pattern.height), Range(pattern.x, pattern.x + pattern.width));
 
-    // remove color factor, since it's not relevant
-    Mat inputGray;
-    cvtColor(cropped, inputGray, COLOR_BGR2GRAY);
+    Mat inputEdges;
+    computeFrameEdges(cropped, inputEdges);
 
-    Mat patternGray;
-    cvtColor(pattern.image, patternGray, COLOR_BGR2GRAY);
+    // logos added to the channel already have their edges
+    Mat patternEdges = pattern.edges;
+    if (patternEdges.empty())
+        computeLogoEdges(pattern.image, patternEdges);
 
-    // blur the image, so the edge detection (canny) works better
-    Mat inputBlur;
-    GaussianBlur(inputGray, inputBlur, Size(5, 5), 0);
+    return (int)compareLogoEdges(inputEdges, patternEdges) >= 15;
+}
 
-    Mat patternBlur;
-    GaussianBlur(patternGray, patternBlur, Size(5, 5), 0);
+bool camicasa::TVChannel::matchLogos(Mat &input, vector<LogoMatch> &matches)
+{
+    ScopedTrace trace("matchLogos");
 
-    // canny edge detection
-    Mat inputEdges;
-    Canny(inputBlur, inputEdges, 50, 60, 3, true);
+    matches.clear();
 
-    Mat patternEdges;
-    Canny(patternBlur, patternEdges, 50, 100, 3);
+    for (int corner = TOP_LEFT; corner <= NONE; corner++)
+    {
+        vector<int> &indexes = this->cornerLogos[corner];
 
-    Mat bitwise;
-    bitwise_and(patternEdges, inputEdges, bitwise);
-    
-    return (screenThresholdDetection(bitwise, CHECK_BIGGER, 15));
+        if (indexes.empty())
+            continue;
+
+        // edges of the area covering all logos of the corner, shared by all of them
+        Rect bounds = this->cornerLogoBounds[corner];
+        Mat &boundsEdges = this->cornerEdges[corner];
+
+        if (corner != NONE){
+            computeFrameEdges(input(bounds), boundsEdges, this->grayBuffer, this->blurBuffer);
+            integral(boundsEdges, this->edgesIntegral, CV_32S);
+        }
+
+        for (int i = 0; i < indexes.size(); i++)
+        {
+            const Logo &logo = this->logos[indexes[i]];
+            Rect area(logo.x, logo.y, logo.width, logo.height);
+
+            Mat inputEdges;
+            Rect edgesArea;
+
+            // logos outside the corner regions are compared on their own
+            if (corner == NONE){
+                computeFrameEdges(input(area), boundsEdges, this->grayBuffer, this->blurBuffer);
+                integral(boundsEdges, this->edgesIntegral, CV_32S);
+                inputEdges = boundsEdges;
+                edgesArea = Rect(0, 0, area.width, area.height);
+            }
+            else {
+                edgesArea = Rect(area.x - bounds.x, area.y - bounds.y, area.width, area.height);
+                inputEdges = boundsEdges(edgesArea);
+            }
+
+            // most logos are ruled out here without going over their pixels
+            if (!mayMatchEdges(hashFrameEdges(this->edgesIntegral, edgesArea), logo))
+                continue;
+
+            LogoMatch match;
+            match.logoId = logo.id;
+            match.score = compareLogoEdges(inputEdges, logo.edges);
+
+            if ((int)match.score >= 15)
+                matches.push_back(match);
+        }
+    }
+
+    return !matches.empty();
 }
 
 void camicasa::TVChannel::updateSegment(int id, int newStart, int newEnd){
@@ -195,6 +557,587 @@ void camicasa::TVChannel::updateSegment(int id, int newStart, int newEnd){
     }
 }
 
+void camicasa::TVChannel::setAdIndex(AdIndex *index, bool learn){
+    this->adIndex = index;
+    this->learnAds = learn;
+}
+
+void camicasa::TVChannel::rememberAd(Segment &segment){
+    if (segment.type != AD || segment.adAssociated != -1 || segment.fingerprint.size() < FINGERPRINT_LENGTH)
+        return;
+
+    segment.adAssociated = this->adIndex->add(segment.fingerprint, segment.endTimestamp - segment.startTimestamp);
+}
+
+void camicasa::TVChannel::rememberAds(){
+    if (this->adIndex == NULL)
+        return;
+
+    for (int i = 0; i < this->segments.size(); i++)
+        this->rememberAd(this->segments[i]);
+}
+
+int camicasa::TVChannel::fingerprintSegment(Mat &frame, int timestamp){
+    Segment &segment = this->currentSegment;
+
+    // one frame a second from half a second in, so airings cut a few frames apart hash about the same frames
+    if (segment.fingerprint.size() >= FINGERPRINT_LENGTH || timestamp - segment.startTimestamp < 500 + 1000 * (int)segment.fingerprint.size())
+        return NO_EVENT;
+
+    ScopedTrace trace("fingerprint");
+    trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+    segment.fingerprint.push_back(hashFrame(frame));
+
+    if (segment.fingerprint.size() < FINGERPRINT_LENGTH || segment.type == PROGRAM)
+        return NO_EVENT;
+
+    segment.adAssociated = this->adIndex->find(segment.fingerprint, &segment.adDuration);
+    if (segment.adAssociated == -1)
+        return NO_EVENT;
+
+    cout << "Segment " << segment.id << " is the known ad " << segment.adAssociated << "\n";
+    return AD_IDENTIFIED;
+}
+
+void camicasa::TVChannel::closeSegment(int timestamp){
+    this->currentSegment.endTimestamp = timestamp;
+
+    if (this->adIndex != NULL && this->learnAds)
+        this->rememberAd(this->currentSegment);
+
+    this->addSegment(this->currentSegment);
+
+    this->startSegment = false;
+    this->logoAlreadyFound = false;
+
+    // reset currentSegment
+    this->currentSegment.id++;
+    this->currentSegment.type = AD;
+    this->currentSegment.logoAssociated = -1;
+    this->currentSegment.adAssociated = -1;
+    this->currentSegment.adDuration = 0;
+    this->currentSegment.fingerprint.clear();
+}
+
+bool camicasa::TVChannel::isBlackFrame(Mat &frame){
+    ScopedTrace trace("blackDetection");
+
+    return screenThresholdDetection(frame, CHECK_SMALLER, 1, this->blackFrameStride);
+}
+
+bool camicasa::TVChannel::isLogoFound(){
+    return this->logoAlreadyFound;
+}
+
+int camicasa::TVChannel::processFrame(Mat &frame, int timestamp, int frameNumber, int black){
+    ScopedTrace trace("processFrame");
+    trace.annotate(this->currentSegment.id, stringifyTVChannelType(this->currentSegment.type), this->currentSegment.logoAssociated);
+
+    int events = NO_EVENT;
+
+    // the scheduler may have checked the frame already
+    if (black < 0)
+        black = this->isBlackFrame(frame);
+
+    if (!this->alreadyBlack && black)
+    {
+        if (this->startSegment)
+        {
+            this->closeSegment(timestamp);
+            events |= SEGMENT_CLOSED;
+        }
+
+        this->alreadyBlack = true;
+        return events;
+    }
+
+    if (this->alreadyBlack && !black)
+        this->alreadyBlack = false;
+
+    if (!this->startSegment)
+    {
+        this->currentSegment.startTimestamp = timestamp;
+        this->startSegment = true;
+        events |= SEGMENT_OPENED;
+    }
+
+    if (this->alreadyBlack)
+        return events;
+
+    if (this->adIndex != NULL)
+        events |= this->fingerprintSegment(frame, timestamp);
+
+    if (!this->logoAlreadyFound && this->currentSegment.type != PROGRAM && this->matchLogos(frame, this->frameMatches)){
+        cout << "Segment " << this->currentSegment.id << " changed to program because a logo was found\n";
+        this->currentSegment.type = PROGRAM;
+        this->logoAlreadyFound = true;
+        events |= SEGMENT_RETYPED;
+    }
+
+    // change segment type after a certain time has passed, unless it is a known ad that has not run clearly past its length
+    // (a black frame missed after it, or a false match)
+    int passedTime = (timestamp - this->currentSegment.startTimestamp) / 1000;
+    bool pastKnownAd = this->currentSegment.adAssociated == -1 ||
+                       timestamp - this->currentSegment.startTimestamp > this->currentSegment.adDuration * 3 / 2 + 5000;
+    if (this->currentSegment.type != PROGRAM && pastKnownAd && this->hasMinimumTimePassed(passedTime)){
+        cout << "Segment " << this->currentSegment.id << " changed to program because of time\n";
+        this->currentSegment.type = PROGRAM;
+        events |= SEGMENT_RETYPED;
+    }
+
+    // reduce the number of frames to search for a logo if none found
+    if (!this->logoAlreadyFound && frameNumber % this->fps == 0)
+    {
+        ScopedTrace searchTrace("logoSearch");
+        searchTrace.annotate(this->currentSegment.id, stringifyTVChannelType(this->currentSegment.type));
+
+        if (this->previousFrame.empty())
+        {
+            frame.copyTo(this->currentFrame);
+            frame.copyTo(this->previousFrame);
+            frame.copyTo(this->operationBitwise);
+            this->resetOperationBitwise = false;
+            return events;
+        }
+
+        if (this->resetOperationBitwise)
+        {
+            this->previousFrame.copyTo(this->operationBitwise);
+            this->resetOperationBitwise = false;
+        }
+
+        // the current frame becomes the previous one and the buffer of the previous one receives the new frame
+        swap(this->previousFrame, this->currentFrame);
+        frame.copyTo(this->currentFrame);
+
+        bitwise_and(this->operationBitwise, this->currentFrame, this->operationBitwise);
+
+        convertToGray(this->operationBitwise, this->operationBitwiseGray);
+
+        this->checkForSaturatedTiles(this->operationBitwiseGray, CHECK_SMALLER, 5);
+
+        this->findLogos(this->currentFrame, this->operationBitwise, this->foundLogos);
+
+        int firstLogoId = -1;
+
+        for (int i = 0; i < this->foundLogos.size(); i++)
+        {
+            Logo &logo = this->foundLogos[i];
+
+            // a logo already known may stay still next to the new ones, while a new logo in its place has other edges
+            bool known = false;
+            for (int j = 0; j < this->logos.size() && !known; j++)
+                known = isSameLogo(this->logos[j], logo) && this->findPatternLogo(this->currentFrame, this->logos[j]);
+
+            if (known)
+                continue;
+
+            logo.id = this->currentLogo.id;
+            cout << "Segment " << this->currentSegment.id << " found a logo at the " << stringifyScreenCorner(logo.screenCorner) << "!\n";
+
+            // addLogo moves the identifier of the next logo past this one
+            this->addLogo(logo);
+            events |= LOGO_FOUND;
+
+            if (firstLogoId == -1)
+                firstLogoId = logo.id;
+        }
+
+        // no logo found
+        if (firstLogoId == -1)
+            return events;
+
+        this->logoAlreadyFound = true;
+
+        if (this->currentSegment.type != PROGRAM){
+            this->currentSegment.type = PROGRAM;
+            cout << "Segment " << this->currentSegment.id << " changed to program because a logo was detected\n";
+            events |= SEGMENT_RETYPED;
+        }
+
+        this->currentSegment.logoAssociated = firstLogoId;
+    }
+
+    if (!this->hasStillFrames())
+    {
+        // the copy waits for the next sampled frame, the previous frame does not change until then
+        this->resetOperationBitwise = true;
+
+        if (this->logoAlreadyFound){
+            this->currentSegment.endTimestamp = timestamp;
+            this->logoAlreadyFound = false;
+        }
+    }
+
+    return events;
+}
+
+int camicasa::TVChannel::finishStream(int timestamp){
+    if (!this->startSegment)
+        return NO_EVENT;
+
+    this->closeSegment(timestamp);
+    return SEGMENT_CLOSED;
+}
+
+/// @brief Write a segment as a map of the checkpoint
+static void writeSegment(FileStorage &storage, Segment &segment)
+{
+    storage << "{";
+    storage << "id" << segment.id;
+    storage << "startTimestamp" << segment.startTimestamp;
+    storage << "endTimestamp" << segment.endTimestamp;
+    storage << "type" << (int)segment.type;
+    storage << "logoAssociated" << segment.logoAssociated;
+    storage << "adAssociated" << segment.adAssociated;
+    storage << "adDuration" << segment.adDuration;
+
+    // the hashes do not fit the integers of the checkpoint
+    storage << "fingerprint" << "[";
+    for (int i = 0; i < segment.fingerprint.size(); i++){
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)segment.fingerprint[i]);
+        storage << string(hash);
+    }
+    storage << "]";
+    storage << "}";
+}
+
+/// @brief Read a segment written by writeSegment
+static Segment readSegment(const FileNode &node)
+{
+    Segment segment;
+    segment.id = (int)node["id"];
+    segment.startTimestamp = (int)node["startTimestamp"];
+    segment.endTimestamp = (int)node["endTimestamp"];
+    segment.type = (TVChannelType)(int)node["type"];
+    segment.logoAssociated = (int)node["logoAssociated"];
+    // checkpoints written before ads were fingerprinted
+    segment.adAssociated = node["adAssociated"].empty() ? -1 : (int)node["adAssociated"];
+    segment.adDuration = node["adDuration"].empty() ? 0 : (int)node["adDuration"];
+
+    FileNode fingerprint = node["fingerprint"];
+    for (FileNodeIterator it = fingerprint.begin(); it != fingerprint.end(); ++it)
+        segment.fingerprint.push_back(strtoull(((string)*it).c_str(), NULL, 16));
+
+    return segment;
+}
+
+bool camicasa::TVChannel::saveCheckpoint(string path, int timestamp, int frameNumber){
+    string temporary = path + ".tmp";
+
+    FileStorage storage(temporary, FileStorage::WRITE | FileStorage::FORMAT_YAML);
+
+    if (!storage.isOpened()){
+        puts("Error writing checkpoint");
+        return false;
+    }
+
+    storage << "timestamp" << timestamp;
+    storage << "frameNumber" << frameNumber;
+    storage << "frameWidth" << this->frameWidth;
+    storage << "frameHeight" << this->frameHeight;
+    storage << "analysisScale" << this->analysisScale;
+
+    storage << "segments" << "[";
+    for (int i = 0; i < this->segments.size(); i++)
+        writeSegment(storage, this->segments[i]);
+    storage << "]";
+
+    storage << "logos" << "[";
+    for (int i = 0; i < this->logos.size(); i++){
+        Logo &logo = this->logos[i];
+
+        storage << "{";
+        storage << "id" << logo.id;
+        storage << "x" << logo.x;
+        storage << "y" << logo.y;
+        storage << "width" << logo.width;
+        storage << "height" << logo.height;
+        storage << "screenCorner" << (int)logo.screenCorner;
+        storage << "image" << logo.image;
+        storage << "}";
+    }
+    storage << "]";
+
+    storage << "frameStillCount" << this->frameStillCount;
+    storage << "currentSegment";
+    writeSegment(storage, this->currentSegment);
+    storage << "nextLogoId" << this->currentLogo.id;
+    storage << "alreadyBlack" << (int)this->alreadyBlack;
+    storage << "startSegment" << (int)this->startSegment;
+    storage << "logoAlreadyFound" << (int)this->logoAlreadyFound;
+
+    // the sampled frames the still counters were computed from, so the search for new logos goes on where it was
+    storage << "currentFrame" << this->currentFrame;
+    storage << "previousFrame" << this->previousFrame;
+    storage << "operationBitwise" << this->operationBitwise;
+    storage << "resetOperationBitwise" << (int)this->resetOperationBitwise;
+
+    storage.release();
+
+    return rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+bool camicasa::TVChannel::loadCheckpoint(string path, int &timestamp, int &frameNumber){
+    FileStorage storage;
+
+    try {
+        if (!storage.open(path, FileStorage::READ))
+            return false;
+    }
+    catch (cv::Exception &e) {
+        puts("Error reading checkpoint");
+        return false;
+    }
+
+    if ((int)storage["frameWidth"] != this->frameWidth || (int)storage["frameHeight"] != this->frameHeight ||
+        fabs((double)storage["analysisScale"] - this->analysisScale) > 1e-9){
+        puts("Checkpoint belongs to another input or analysis scale");
+        return false;
+    }
+
+    timestamp = (int)storage["timestamp"];
+    frameNumber = (int)storage["frameNumber"];
+
+    this->segments.clear();
+    FileNode segments = storage["segments"];
+    for (FileNodeIterator it = segments.begin(); it != segments.end(); ++it)
+        this->segments.push_back(readSegment(*it));
+
+    this->logos.clear();
+    for (int i = 0; i <= NONE; i++)
+        this->cornerLogos[i].clear();
+
+    FileNode logos = storage["logos"];
+    for (FileNodeIterator it = logos.begin(); it != logos.end(); ++it){
+        Logo logo;
+        logo.id = (int)(*it)["id"];
+        logo.x = (int)(*it)["x"];
+        logo.y = (int)(*it)["y"];
+        logo.width = (int)(*it)["width"];
+        logo.height = (int)(*it)["height"];
+        logo.screenCorner = (ScreenCorner)(int)(*it)["screenCorner"];
+        (*it)["image"] >> logo.image;
+
+        this->addLogo(logo);
+    }
+
+    storage["frameStillCount"] >> this->frameStillCount;
+    // a checkpoint of another grid starts counting over
+    if (this->frameStillCount.size() != this->gridColumns * this->gridRows)
+        this->frameStillCount.assign(this->gridColumns * this->gridRows, 0);
+
+    this->currentSegment = readSegment(storage["currentSegment"]);
+    this->currentLogo.id = (int)storage["nextLogoId"];
+    this->alreadyBlack = (int)storage["alreadyBlack"];
+    this->startSegment = (int)storage["startSegment"];
+    this->logoAlreadyFound = (int)storage["logoAlreadyFound"];
+
+    storage["currentFrame"] >> this->currentFrame;
+    storage["previousFrame"] >> this->previousFrame;
+    storage["operationBitwise"] >> this->operationBitwise;
+    this->resetOperationBitwise = (int)storage["resetOperationBitwise"];
+
+    // checkpoints written without the sampled frames, the search for new logos starts over from the next sampled frame
+    if (this->previousFrame.empty() || this->operationBitwise.empty()){
+        this->currentFrame.release();
+        this->previousFrame.release();
+        this->operationBitwise.release();
+        this->resetOperationBitwise = false;
+        this->frameStillCount.assign(this->gridColumns * this->gridRows, 0);
+    }
+
+    return true;
+}
+
+camicasa::SegmentExporter::SegmentExporter(TVChannel *channel, string directory, int fps, Size frameSize, int maximumPendingFrames, const VideoOptions &options)
+    : encoder(directory, fps, frameSize, options),
+      heldFrames(directory + "/held.spool", (maximumPendingFrames < 0) ? 10 * fps : maximumPendingFrames),
+      heldAnalysisFrames(directory + "/held-analysis.spool", (maximumPendingFrames < 0) ? 10 * fps : maximumPendingFrames) {
+    this->channel = channel;
+    this->maximumPendingFrames = (maximumPendingFrames < 0) ? 10 * fps : maximumPendingFrames;
+    this->segmentId = -1;
+    this->scannedFrames = 0;
+    this->scannedLogos = 0;
+    this->sharedAnalysis = false;
+    this->foundNewStart = false;
+    this->newStart = 0;
+    this->newEnd = 0;
+}
+
+camicasa::SegmentExporter::~SegmentExporter(){
+    this->heldFrames.clear();
+    this->heldAnalysisFrames.clear();
+    this->encoderQueues.clear();
+}
+
+void camicasa::SegmentExporter::setEncoderQueues(vector<BoundedQueue<EncodeJob>*> queues){
+    this->encoderQueues = queues;
+}
+
+void camicasa::SegmentExporter::sendJob(EncodeCommand command, Mat frame){
+    EncodeJob job;
+    job.command = command;
+    job.segmentId = this->segmentId;
+    job.frame = frame;
+
+    if (this->encoderQueues.empty())
+        this->encoder.execute(job);
+    else
+        this->encoderQueues[this->segmentId % this->encoderQueues.size()]->push(job);
+}
+
+void camicasa::SegmentExporter::writeMatchedFrames(){
+    // logos found since the last time may appear on frames already matched
+    int logos = this->channel->getLogos().size();
+    if (logos != this->scannedLogos){
+        this->scannedLogos = logos;
+        this->scannedFrames = 0;
+    }
+
+    Mat frame, analysisFrame;
+
+    for (int i = this->scannedFrames; i < this->heldFrames.size(); i++){
+        if (this->sharedAnalysis)
+            this->heldFrames.read(i, analysisFrame);
+        else
+            this->heldAnalysisFrames.read(i, analysisFrame);
+        if (analysisFrame.empty() || !this->channel->matchLogos(analysisFrame, this->matches))
+            continue;
+
+        // the frames before the first logo appearance are trimmed away
+        if (!this->foundNewStart){
+            this->foundNewStart = true;
+            this->newStart = this->heldFrames.timestampAt(i);
+            this->heldFrames.discardFront(i);
+            this->heldAnalysisFrames.discardFront(i);
+            i = 0;
+        }
+
+        this->newEnd = this->heldFrames.timestampAt(i);
+
+        // the spool gives frames of their own, so they can be handed to the encoder without copying
+        for (int j = 0; j <= i; j++){
+            this->heldFrames.read(j, frame);
+            if (!frame.empty())
+                this->sendJob(WRITE_FRAME, frame);
+        }
+
+        this->heldFrames.discardFront(i + 1);
+        this->heldAnalysisFrames.discardFront(i + 1);
+        i = -1;
+    }
+
+    this->scannedFrames = this->heldFrames.size();
+}
+
+void camicasa::SegmentExporter::writeHeldFrames(){
+    Mat frame;
+
+    for (int i = 0; i < this->heldFrames.size(); i++){
+        this->heldFrames.read(i, frame);
+        if (!frame.empty())
+            this->sendJob(WRITE_FRAME, frame);
+    }
+
+    this->heldFrames.clear();
+    this->heldAnalysisFrames.clear();
+    this->scannedFrames = 0;
+}
+
+void camicasa::SegmentExporter::addFrame(Mat &frame, Mat &analysisFrame, int timestamp){
+    Segment segment = this->channel->getCurrentSegment();
+
+    ScopedTrace trace("exportFrame");
+    trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+    if (segment.id != this->segmentId){
+        this->segmentId = segment.id;
+        this->firstFrame = frame.clone();
+        this->sharedAnalysis = analysisFrame.data == frame.data;
+        this->heldFrames.clear();
+        this->heldAnalysisFrames.clear();
+        this->scannedFrames = 0;
+        this->scannedLogos = -1;
+        this->foundNewStart = false;
+        this->newStart = segment.startTimestamp;
+        this->newEnd = segment.startTimestamp;
+        this->sendJob(OPEN_SEGMENT);
+    }
+
+    // the frame given is reused by the decoder, so the spool keeps its own copy
+    bool held = this->heldFrames.push(frame, timestamp);
+
+    if (!held || (!this->sharedAnalysis && !this->heldAnalysisFrames.push(analysisFrame, timestamp))){
+        puts("Error holding frame, segment written untrimmed");
+
+        if (!this->foundNewStart && this->heldFrames.size() > 0)
+            this->newStart = this->heldFrames.timestampAt(0);
+
+        this->foundNewStart = true;
+        this->newEnd = timestamp;
+        this->writeHeldFrames();
+
+        if (!held)
+            this->sendJob(WRITE_FRAME, frame.clone());
+        return;
+    }
+
+    // ads are held whole until they close, as they may become programs
+    if (segment.type != PROGRAM)
+        return;
+
+    this->writeMatchedFrames();
+}
+
+Segment camicasa::SegmentExporter::closeSegment(Mat &frame){
+    Segment segment = this->channel->getSegments().back();
+
+    ScopedTrace trace("closeSegment");
+    trace.annotate(segment.id, stringifyTVChannelType(segment.type), segment.logoAssociated);
+
+    if (segment.id != this->segmentId){
+        this->segmentId = segment.id;
+        this->heldFrames.clear();
+        this->heldAnalysisFrames.clear();
+        this->scannedFrames = 0;
+        this->scannedLogos = -1;
+        this->foundNewStart = false;
+        this->newStart = segment.startTimestamp;
+        this->newEnd = segment.startTimestamp;
+        this->sendJob(OPEN_SEGMENT);
+    }
+
+    if (segment.type == PROGRAM){
+        // matched again with every logo found until the end, the frames after the last appearance are trimmed away
+        this->writeMatchedFrames();
+
+        // no logo found, the program is reduced to its first frame
+        if (!this->foundNewStart && !this->firstFrame.empty())
+            this->sendJob(WRITE_FRAME, this->firstFrame);
+
+        this->channel->updateSegment(segment.id, this->newStart, this->newEnd);
+        segment.startTimestamp = this->newStart;
+        segment.endTimestamp = this->newEnd;
+    }
+    else {
+        this->writeHeldFrames();
+
+        if (!frame.empty())
+            this->sendJob(WRITE_FRAME, frame.clone());
+    }
+
+    this->sendJob(CLOSE_SEGMENT);
+    this->heldFrames.clear();
+    this->heldAnalysisFrames.clear();
+    this->firstFrame.release();
+    this->segmentId = -1;
+
+    return segment;
+}
+
 string camicasa::formatTimestamp(int duration)
 {
     int hour = (int)((duration / (1000 * 60 * 60)) % 24);
@@ -219,13 +1162,26 @@ void camicasa::convertBinarizedFrame(Mat &input, Mat &output, BinarizationMode m
         output = ~input;
 }
 
-void camicasa::cropLogo(Mat &inputOriginal, Mat &inputBitwise, Logo& output)
+/// @brief Find the group of a box of camicasa::extractLogos, flattening the path to it
+static int findGroup(vector<int> &groups, int box)
 {
+    while (groups[box] != box){
+        groups[box] = groups[groups[box]];
+        box = groups[box];
+    }
+
+    return box;
+}
+
+void camicasa::extractLogos(Mat &inputOriginal, Mat &inputBitwise, vector<Logo> &output, int minimumArea)
+{
+    output.clear();
+
     Mat bitwise;
     bitwise_and(inputOriginal, inputBitwise, bitwise);
 
     Mat bitwise_gray;
-    cvtColor(bitwise, bitwise_gray, COLOR_BGR2GRAY);
+    convertToGray(bitwise, bitwise_gray);
 
     Mat otsuThresh;
     threshold(bitwise_gray, otsuThresh, 0, 255, THRESH_OTSU);
@@ -233,65 +1189,292 @@ void camicasa::cropLogo(Mat &inputOriginal, Mat &inputBitwise, Logo& output)
 
     morphOperation(otsuThresh, otsuThresh);
 
-    int startX = 0;
-    int startY = 0;
-    int endX = 0;
-    int endY = 0;
+    // the bounding box and area of each component come from the labelling pass itself
+    Mat labels, stats, centroids;
+    int count = connectedComponentsWithStats(otsuThresh, labels, stats, centroids, 8, CV_32S);
 
-    int margin = 5;
+    // letters and symbols of a logo are components apart, grouped when closer than this distance
+    int linkDistance = 5;
+    // pixels kept around the box, so the blur of the edges of the logo has the pixels it needs
+    int margin = 2;
+    // share of the box covered by the pixels of the logo, below which the group is noise spread over the area
+    double minimumDensity = 0.05;
 
-    bool foundStartX = false;
-    bool foundStartY = false;
+    vector<Rect> boxes;
+    vector<int> areas;
 
-    for (int row = 0; row < inputOriginal.rows; row++)
-    {
-        for (int column = 0; column < inputOriginal.cols; column++)
-        {
-            int value = (int)otsuThresh.at<uchar>(row, column);
+    for (int label = 1; label < count; label++){
+        Rect box(stats.at<int>(label, CC_STAT_LEFT), stats.at<int>(label, CC_STAT_TOP),
+                 stats.at<int>(label, CC_STAT_WIDTH), stats.at<int>(label, CC_STAT_HEIGHT));
 
-            if (value && row < startY)
-            {
-                startY = row;
-                foundStartY = true;
-            }
+        boxes.push_back(box);
+        areas.push_back(stats.at<int>(label, CC_STAT_AREA));
+    }
 
-            if (value && column < startX)
-            {
-                startX = column;
-                foundStartX = true;
-            }
+    // groups are joined with a union-find over the pairs of close boxes, and joined again while the box of a group grows
+    // close to another one (usually a single round)
+    bool merged = true;
+    while (merged){
+        merged = false;
+
+        vector<int> groups(boxes.size());
+        for (int i = 0; i < groups.size(); i++)
+            groups[i] = i;
+
+        for (int i = 0; i < boxes.size(); i++){
+            Rect linked(boxes[i].x - linkDistance, boxes[i].y - linkDistance, boxes[i].width + 2 * linkDistance, boxes[i].height + 2 * linkDistance);
 
-            if (!foundStartX && value)
-            {
-                startX = column;
-                foundStartX = true;
+            for (int j = i + 1; j < boxes.size(); j++){
+                if ((linked & boxes[j]).empty())
+                    continue;
+
+                int first = findGroup(groups, i);
+                int second = findGroup(groups, j);
+
+                if (first != second){
+                    groups[second] = first;
+                    merged = true;
+                }
             }
+        }
 
-            if (foundStartX && value && column >= endX)
-                endX = column;
+        if (!merged)
+            break;
 
-            if (!foundStartY && value)
-            {
-                startY = row;
-                foundStartY = true;
+        vector<Rect> groupBoxes;
+        vector<int> groupAreas;
+        vector<int> index(boxes.size(), -1);
+
+        for (int i = 0; i < boxes.size(); i++){
+            int group = findGroup(groups, i);
+
+            if (index[group] == -1){
+                index[group] = groupBoxes.size();
+                groupBoxes.push_back(boxes[i]);
+                groupAreas.push_back(areas[i]);
+            }
+            else {
+                groupBoxes[index[group]] = groupBoxes[index[group]] | boxes[i];
+                groupAreas[index[group]] += areas[i];
             }
+        }
+
+        boxes = groupBoxes;
+        areas = groupAreas;
+    }
+
+    Rect frame(0, 0, inputOriginal.cols, inputOriginal.rows);
+
+    for (int i = 0; i < boxes.size(); i++){
+        if (areas[i] < minimumArea || areas[i] < minimumDensity * boxes[i].area())
+            continue;
+
+        Rect box(boxes[i].x - margin, boxes[i].y - margin, boxes[i].width + 2 * margin, boxes[i].height + 2 * margin);
+        box = box & frame;
+
+        Logo logo;
+        logo.x = box.x;
+        logo.y = box.y;
+        logo.width = box.width;
+        logo.height = box.height;
+        logo.image = inputBitwise(box);
+
+        output.push_back(logo);
+    }
+}
+
+void camicasa::cropLogo(Mat &inputOriginal, Mat &inputBitwise, Logo& output)
+{
+    vector<Logo> logos;
+    extractLogos(inputOriginal, inputBitwise, logos, 1);
+
+    // the logo covering most of the area
+    Logo largest;
+    for (int i = 0; i < logos.size(); i++)
+        if (logos[i].width * logos[i].height > largest.width * largest.height)
+            largest = logos[i];
+
+    // the identifier and the other fields of the caller are kept, the edges follow the new image
+    output.x = largest.x;
+    output.y = largest.y;
+    output.width = largest.width;
+    output.height = largest.height;
+    output.image = largest.image;
+    output.edges.release();
+    output.edgeCells.clear();
+    output.edgeHash = 0;
+}
+
+void camicasa::convertToGray(const Mat &input, Mat &output)
+{
+    if (input.channels() == 1)
+        output = input;
+    else
+        cvtColor(input, output, COLOR_BGR2GRAY);
+}
+
+void camicasa::computeFrameEdges(const Mat &input, Mat &edges)
+{
+    Mat gray;
+    Mat blur;
+    computeFrameEdges(input, edges, gray, blur);
+}
+
+void camicasa::computeFrameEdges(const Mat &input, Mat &edges, Mat &gray, Mat &blur)
+{
+    // remove color factor, since it's not relevant
+    convertToGray(input, gray);
+
+    // blur the image, so the edge detection (canny) works better
+    GaussianBlur(gray, blur, Size(5, 5), 0);
+
+    // canny edge detection
+    Canny(blur, edges, 50, 60, 3, true);
+}
+
+double camicasa::compareLogoEdges(const Mat &inputEdges, const Mat &patternEdges)
+{
+    if (inputEdges.empty() || inputEdges.rows != patternEdges.rows || inputEdges.cols != patternEdges.cols)
+        return 0;
+
+    // the average of the bitwise_and of both edges, counted without building it
+    int count = 0;
 
-            if (foundStartY && value && row >= endY)
-                endY = row;
+    for (int row = 0; row < inputEdges.rows; row++)
+    {
+        const uchar *input = inputEdges.ptr<uchar>(row);
+        const uchar *pattern = patternEdges.ptr<uchar>(row);
+
+        for (int column = 0; column < inputEdges.cols; column++)
+            count += (input[column] & pattern[column]) != 0;
+    }
+
+    return 255.0 * count / inputEdges.total();
+}
+
+/// @brief First row (or column) of the cell of an 8x8 grid over a length, so that the cell of a position p is 8 * p / length
+static inline int cellStart(int length, int cell)
+{
+    return (length * cell + 7) / 8;
+}
+
+void camicasa::computeEdgeCells(const Mat &edges, vector<int> &cells, uint64_t &hash)
+{
+    cells.assign(64, 0);
+    hash = 0;
+
+    for (int row = 0; row < edges.rows; row++)
+    {
+        const uchar *pixels = edges.ptr<uchar>(row);
+        int *cellRow = cells.data() + 8 * (8 * row / edges.rows);
+
+        for (int column = 0; column < edges.cols; column++)
+            cellRow[8 * column / edges.cols] += pixels[column] != 0;
+    }
+
+    for (int cell = 0; cell < 64; cell++)
+        if (cells[cell] > 0)
+            hash |= (uint64_t)1 << cell;
+}
+
+uint64_t camicasa::hashFrameEdges(const Mat &integral, Rect area)
+{
+    uint64_t hash = 0;
+
+    for (int cellRow = 0; cellRow < 8; cellRow++)
+    {
+        const int *top = integral.ptr<int>(area.y + cellStart(area.height, cellRow));
+        const int *bottom = integral.ptr<int>(area.y + cellStart(area.height, cellRow + 1));
+
+        for (int cellColumn = 0; cellColumn < 8; cellColumn++)
+        {
+            int left = area.x + cellStart(area.width, cellColumn);
+            int right = area.x + cellStart(area.width, cellColumn + 1);
+
+            if (bottom[right] - top[right] - bottom[left] + top[left] > 0)
+                hash |= (uint64_t)1 << (8 * cellRow + cellColumn);
         }
     }
 
-    // margin calculation, making sure it doesn't overflow
-    startX = (startX - margin >= 0) ? startX - margin : 0;
-    startY = (startY - margin >= 0) ? startY - margin : 0;
-    endX = (endX + margin < inputOriginal.cols) ? endX + margin : inputOriginal.cols - 1;
-    endY = (endY + margin < inputOriginal.rows) ? endY + margin : inputOriginal.rows - 1;
+    return hash;
+}
+
+bool camicasa::mayMatchEdges(uint64_t frameHash, const Logo &logo)
+{
+    // the edges of the logo can only match in the cells where the frame has edges
+    uint64_t common = frameHash & logo.edgeHash;
+
+    if (logo.edgeCells.size() != 64)
+        return true;
+
+    // the score is 255 * matches / pixels, found when it reaches 15
+    long long needed = 15LL * (long long)logo.edges.total();
+
+    if (__builtin_popcountll(common) == 0)
+        return needed <= 0;
+
+    long long bound = 0;
+
+    while (common)
+    {
+        bound += logo.edgeCells[__builtin_ctzll(common)];
+
+        if (255 * bound >= needed)
+            return true;
+
+        common &= common - 1;
+    }
+
+    return false;
+}
+
+bool camicasa::isSameLogo(const Logo& a, const Logo& b)
+{
+    if (a.screenCorner != b.screenCorner)
+        return false;
+
+    Rect first(a.x, a.y, a.width, a.height);
+    Rect second(b.x, b.y, b.width, b.height);
+    Rect intersection = first & second;
+
+    if (2 * intersection.area() < min(a.width * a.height, b.width * b.height))
+        return false;
+
+    // logos found apart are cropped from other frames, so only their edges tell them apart
+    if (a.edges.empty() || b.edges.empty() || a.edges.cols != a.width || a.edges.rows != a.height ||
+        b.edges.cols != b.width || b.edges.rows != b.height)
+        return true;
+
+    Mat edgesA = a.edges(Rect(intersection.x - a.x, intersection.y - a.y, intersection.width, intersection.height));
+    Mat edgesB = b.edges(Rect(intersection.x - b.x, intersection.y - b.y, intersection.width, intersection.height));
+
+    int countA = countNonZero(edgesA);
+    int countB = countNonZero(edgesB);
+    if (countA + countB == 0)
+        return true;
+
+    // a pixel of tolerance, as the crops of the same logo differ slightly
+    Mat nearA, nearB, matched;
+    dilate(edgesA, nearA, Mat());
+    dilate(edgesB, nearB, Mat());
+
+    bitwise_and(edgesA, nearB, matched);
+    int common = countNonZero(matched);
+    bitwise_and(edgesB, nearA, matched);
+    common += countNonZero(matched);
+
+    return 2 * common >= countA + countB;
+}
+
+void camicasa::computeLogoEdges(const Mat &image, Mat &edges)
+{
+    Mat gray;
+    convertToGray(image, gray);
+
+    Mat blur;
+    GaussianBlur(gray, blur, Size(5, 5), 0);
 
-    output.x = startX;
-    output.y = startY;
-    output.width = endX - startX;
-    output.height = endY - startY;
-    output.image = inputBitwise(Range(startY, endY), Range(startX, endX));
+    Canny(blur, edges, 50, 100, 3);
 }
 
 void camicasa::morphOperation(Mat &input, Mat &output)
@@ -3,6 +3,8 @@
 
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <cstdint>
+#include "pipeline.hpp"
 
 using namespace cv;
 using namespace std;
@@ -21,6 +23,10 @@ namespace camicasa
     enum TVChannelType {AD, PROGRAM};
     /// @brief enum camicasa::ScreenCorner used for defining which corner a certain element is located on the screen
     enum ScreenCorner {TOP_LEFT, TOP_RIGHT, BOTTOM_LEFT, BOTTOM_RIGHT, NONE};
+    /// @brief enum camicasa::AnalysisEvent used as bit flags for reporting what happened while analysing a frame
+    enum AnalysisEvent {NO_EVENT = 0, SEGMENT_OPENED = 1, SEGMENT_CLOSED = 2, LOGO_FOUND = 4, SEGMENT_RETYPED = 8, AD_IDENTIFIED = 16};
+
+    class AdIndex;
 
     /// @brief struct camicasa::Segment containing information about a segment present in a television program
     struct Segment {
@@ -29,12 +35,26 @@ namespace camicasa
         int endTimestamp = 0;
         TVChannelType type = AD;
         int logoAssociated = -1;
+        int adAssociated = -1;
+        /// @brief duration in milliseconds of the first airing of the known ad, 0 if none
+        int adDuration = 0;
+        /// @brief hashes of the first seconds of the segment, as computed by camicasa::hashFrame()
+        vector<uint64_t> fingerprint;
+    };
+
+    /// @brief struct camicasa::LogoMatch containing how much a logo matched a frame
+    struct LogoMatch {
+        int logoId = -1;
+        double score = 0;
     };
 
     /// @brief struct camicasa::Logo containing information about logos found in a television program
     struct Logo{
         int id = 1;
         Mat image;
+        Mat edges;
+        uint64_t edgeHash = 0;
+        vector<int> edgeCells;
         int x = 0;
         int y = 0;
         int width = 0;
@@ -42,6 +62,74 @@ namespace camicasa
         ScreenCorner screenCorner = NONE;
     };
 
+    /**
+        @brief class camicasa::RegionStatistics answering the mean and variance of the pixels of any rectangle of a frame in 
+        constant time, from integral images computed once per frame
+        @note Means and variances are over all the channels of the pixels, as camicasa::screenThresholdDetection averages them
+    */
+    class RegionStatistics {
+    private:
+        /// @brief integral image (CV_32S) of the frame
+        Mat sums;
+        /// @brief integral image (CV_64F) of the squares of the frame
+        Mat squareSums;
+        /// @brief number of channels of the frame
+        int channels = 1;
+        /// @brief integral image sampled at the lines of the grid of camicasa::RegionStatistics::gridSums
+        Mat gridSamples;
+
+        /// @returns returns the sum of the pixels of the area over all channels, from the given integral image
+        template <typename T>
+        double sumArea(const Mat &integral, Rect area);
+
+    public:
+        /**
+            @brief The function camicasa::RegionStatistics::compute computes the integral images of a frame, reusing the buffers
+            of the previous one
+            @param frame 8-bit image frame input cv::Mat
+            @param squares optional flag to compute the squares too, which only the variances need (default is true)
+        */
+        void compute(const Mat &frame, bool squares = true);
+
+        /// @returns returns true if no frame was computed
+        bool empty();
+
+        /**
+            @brief The function camicasa::RegionStatistics::mean finds the average of the pixels of a region
+            @param area region of the frame, clipped to it
+            @returns returns the average, 0 for an empty region
+        */
+        double mean(Rect area);
+
+        /**
+            @brief The function camicasa::RegionStatistics::variance finds the variance of the pixels of a region
+            @param area region of the frame, clipped to it
+            @returns returns the variance, 0 for an empty region
+            @note Needs the squares, see camicasa::RegionStatistics::compute()
+        */
+        double variance(Rect area);
+
+        /**
+            @brief The function camicasa::RegionStatistics::thresholdDetection checks a region as camicasa::screenThresholdDetection
+            checks a frame, with the same answer
+            @param area region of the frame, clipped to it
+            @param operation defines camicasa::ComparisonOperation to execute (default is CHECK_SMALLER)
+            @param threshold optional threshold to compare (default is 1)
+            @returns returns true if the region has average pixels that fall under/above the specified threshold
+        */
+        bool thresholdDetection(Rect area, ComparisonOperation operation = CHECK_SMALLER, int threshold = 1);
+
+        /**
+            @brief The function camicasa::RegionStatistics::gridSums adds up the pixels of every tile of a grid at once, sampling 
+            the integral image at the lines of the grid and subtracting whole rows of samples
+            @param columns sorted x coordinates of the vertical lines of the grid, from 0 to the width of the frame
+            @param rows sorted y coordinates of the horizontal lines of the grid, from 0 to the height of the frame
+            @param[out] sums sums (CV_32S) of the tiles, one row of tiles per row of the grid
+            @note The sums of a tile must fit in 32 bits, as they do for any 8-bit grayscale frame up to 4K
+        */
+        void gridSums(const vector<int> &columns, const vector<int> &rows, Mat &sums);
+    };
+
     /// @brief class camicasa::TVChannel containing pertinent information of the television programs
     class TVChannel {
     private:
@@ -53,17 +141,95 @@ namespace camicasa
         int fps;
         /// @brief minimum time in seconds for a segment to be considered a program
         int minimumTime;
+        /// @brief step between the rows averaged when checking for black frames
+        int blackFrameStride;
+        /// @brief scale of the grayscale frames analysed, 0 if the frames of the input are analysed
+        double analysisScale;
         /// @brief vector of cv::Points that define all four corners of the screen
         vector<cv::Point> corners;
+        /// @brief vector of cv::Rect with the area of the screen of each corner, grouping the logos for camicasa::TVChannel::matchLogos
+        /// (new logos are searched on the tiles of camicasa::TVChannel::findLogos and camicasa::TVChannel::checkForSaturatedTiles)
+        vector<Rect> cornerRegions;
+        /// @brief statistics of the regions of the still pixels, as checked by camicasa::TVChannel::checkForSaturatedTiles
+        RegionStatistics regionStatistics;
+        /// @brief number of columns and rows of the grid of tiles where logos are searched
+        int gridColumns;
+        int gridRows;
+        /// @brief x coordinates of the vertical lines of the grid of tiles, from 0 to the width of the frame
+        vector<int> tileColumns;
+        /// @brief y coordinates of the horizontal lines of the grid of tiles, from 0 to the height of the frame
+        vector<int> tileRows;
+        /// @brief number of pixels of each tile (CV_32S), one row of tiles per row of the grid
+        Mat tileAreas;
+        /// @brief tiles where no logo is searched (CV_8U, 255 for the inner tiles of the grid)
+        Mat tileIgnored;
+        /// @brief buffers used while updating the still tiles
+        Mat tileSums;
+        Mat tileBounds;
+        Mat tileReset;
+        Mat tileStill;
+        Mat tileLabels;
+        /// @brief logos found on the last sampled frame
+        vector<Logo> foundLogos;
+        /// @brief indexes of the logos lying inside each corner region (position NONE for the ones outside all of them)
+        vector<vector<int>> cornerLogos;
+        /// @brief bounding box of the logos of each corner region, the only area processed by camicasa::TVChannel::matchLogos
+        vector<Rect> cornerLogoBounds;
         /// @brief vector of camicasa::Segment containing all segments in a television program
         vector<camicasa::Segment> segments;
         /// @brief vector of camicasa::Logo containing all logos in a television program
         vector<camicasa::Logo> logos;
-        /// @brief vector with positions representing the four corners of the screen containing the number of consecutive still frames
+        /// @brief vector with the number of consecutive still frames of each tile of the grid, row by row
         vector<int> frameStillCount;
 
+        /// @brief segment currently being classified
+        Segment currentSegment;
+        /// @brief logo candidate used while searching for new logos
+        Logo currentLogo;
+        /// @brief true if the last analysed frame was black
+        bool alreadyBlack;
+        /// @brief true if a segment is open
+        bool startSegment;
+        /// @brief true if a logo was already found in the current segment
+        bool logoAlreadyFound;
+        /// @brief last sampled frame used for logo detection
+        Mat currentFrame;
+        /// @brief sampled frame before camicasa::TVChannel::currentFrame
+        Mat previousFrame;
+        /// @brief accumulated bitwise_and of the sampled frames, where only still pixels survive
+        Mat operationBitwise;
+        /// @brief true if camicasa::TVChannel::operationBitwise must restart from camicasa::TVChannel::previousFrame
+        bool resetOperationBitwise;
+        /// @brief grayscale version of camicasa::TVChannel::operationBitwise
+        Mat operationBitwiseGray;
+        /// @brief logos found on the last frame analysed
+        vector<LogoMatch> frameMatches;
+        /// @brief edges of the logos area of each corner region, as computed by camicasa::TVChannel::matchLogos
+        vector<Mat> cornerEdges;
+        /// @brief buffers used while computing edges
+        Mat grayBuffer;
+        Mat blurBuffer;
+        /// @brief integral image of the edges of the area being matched, for the hashes of camicasa::hashFrameEdges
+        Mat edgesIntegral;
+        /// @brief fingerprints of the known ads, NULL if segments are not fingerprinted
+        AdIndex *adIndex;
+        /// @brief true if the ads closed are added to camicasa::TVChannel::adIndex
+        bool learnAds;
+
+        /// @brief method for closing the current segment and resetting it for the next one
+        void closeSegment(int timestamp);
+
+        /// @brief method for hashing the frames of the first seconds of the current segment, looking it up once all are hashed
+        int fingerprintSegment(Mat &frame, int timestamp);
+
+        /// @brief method for adding an ad not identified to camicasa::TVChannel::adIndex, associating it with the new ad
+        void rememberAd(Segment &segment);
+
         /// @brief method for finding all four corners of the screen with some margin
         void populateCorners();
+
+        /// @brief method for dividing the screen into the grid of tiles, resetting their still frame counters
+        void populateTiles();
         
     public:
         /**
@@ -84,12 +250,76 @@ namespace camicasa
         /// @returns Program::segments
         vector<Segment> getSegments();
 
-        /// @returns Program::logos
-        vector<Logo> getLogos();
+        /// @returns Program::logos, without copying them
+        const vector<Logo>& getLogos();
 
         /// @returns Program::frameStillCount
         vector<int> getFrameStillCount();
 
+        /**
+            @brief The function camicasa::TVChannel::setLogoGrid sets the grid of tiles where logos are searched, on the tiles 
+            along the edges of the screen
+            @param columns number of columns of tiles
+            @param rows number of rows of tiles
+            @note The default grid of 7x5 tiles has corner tiles as large as the corners of camicasa::TVChannel::getCorners(). 
+            Still tiles next to each other are cropped together, so logos across tiles are found whole and distant ones apart
+        */
+        void setLogoGrid(int columns, int rows);
+
+        /// @returns returns the tiles of the grid, row by row
+        vector<Rect> getTiles();
+
+        /// @returns Program::currentSegment
+        Segment getCurrentSegment();
+
+        /**
+            @brief The function camicasa::TVChannel::setBlackFrameStride sets how many rows are skipped when checking for black frames
+            @param stride step between the rows averaged, 1 to average all of them
+            @note See more in camicasa::screenThresholdDetection()
+        */
+        void setBlackFrameStride(int stride);
+
+        /**
+            @brief The function camicasa::TVChannel::setAnalysisScale makes the channel analyse grayscale frames scaled down, 
+            scaling the corners of the screen to match
+            @param scale scale of the analysed frames, 0 to analyse the frames of the input
+            @note Must be set before any frame is processed. The frames given to the channel must be prepared with 
+            camicasa::prepareAnalysisFrame(), and the logos found are in the coordinates of the analysed frames
+        */
+        void setAnalysisScale(double scale);
+
+        /**
+            @brief The function camicasa::TVChannel::setAdIndex makes the channel fingerprint the first seconds of each segment, 
+            so segments airing a known ad are identified as it and stay ads whatever they last
+            @param index camicasa::AdIndex with the known ads, NULL to stop fingerprinting
+            @param learn optional flag adding the ads closed to the index, so they are identified when they air again (default is true)
+            @note Copies of the channel share the index. See more in camicasa::TVChannel::rememberAds()
+        */
+        void setAdIndex(AdIndex *index, bool learn = true);
+
+        /**
+            @brief The function camicasa::TVChannel::rememberAds adds the ads of camicasa::TVChannel::getSegments() not identified 
+            yet to the index, for segments added instead of closed (e.g. stitched from chunks)
+        */
+        void rememberAds();
+
+        /// @returns Program::analysisScale
+        double getAnalysisScale();
+
+        /// @returns returns true if a segment is open
+        bool isSegmentOpen();
+
+        /**
+            @brief The function camicasa::TVChannel::isBlackFrame checks a frame the way camicasa::TVChannel::processFrame does
+            to close segments
+            @param frame image frame input cv::Mat
+            @returns returns true if the frame is black
+        */
+        bool isBlackFrame(Mat &frame);
+
+        /// @returns returns true while the logo found in the open segment stays on screen
+        bool isLogoFound();
+
         /**
             @brief The function camicasa::TVChannel::minimumTimePassed checks if the given time surpasses the minimum time defined
             @param time time to compare (in seconds)
@@ -105,31 +335,35 @@ namespace camicasa
         void addSegment(Segment segment);
 
         /**
-            @brief The function camicasa::TVChannel::addLogo adds a new logo to the vector of logos
+            @brief The function camicasa::TVChannel::addLogo adds a new logo to the vector of logos, keeping its own copy of the 
+            image and precomputing its edges
             @param logo camicasa::Logo to add
+            @note See more in camicasa::computeLogoEdges(). Edges already computed (e.g. by a camicasa::LogoLibrary) are copied 
+            instead, and logos found afterwards get identifiers after the ones added
         */
         void addLogo(Logo logo);
 
         /**
-            @brief The function camicasa::TVChannel::checkForSaturatedCorners is a method for detecting if any corner on the screen has their
-            average pixels
-            under/above the specified threshold
+            @brief The function camicasa::TVChannel::checkForSaturatedTiles is a method counting, for each tile along the edges 
+            of the screen, for how many frames its average pixels stayed under/above the specified threshold
             @param frame image frame input cv::Mat
             @param operation defines which camicasa::ComparisonOperation to execute (default is CHECK_SMALLER)
             @param threshold optional threshold to compare (default is 1)
-            @returns returns true if any of the four corners have saturated pixels under/above the specified threshold
-            @note See more in camicasa::TVChannel::getCorners()
+            @note See more in camicasa::TVChannel::setLogoGrid(). The tiles are added up from a single integral image and their
+            counters updated with whole matrix operations, so larger grids cost about the same
         */
-        void checkForSaturatedCorners(Mat &frame, ComparisonOperation operation = CHECK_SMALLER, int threshold = 1);
+        void checkForSaturatedTiles(Mat &frame, ComparisonOperation operation = CHECK_SMALLER, int threshold = 1);
 
         /**
-            @brief The functions camicasa::findLogo is a method that tries to find a logo given the input frames and history of still frames
+            @brief The functions camicasa::findLogos is a method that tries to find logos given the input frames and history of 
+            still frames, one for each group of neighbouring still tiles
             @param[in] inputOriginal original image frame input cv::Mat
             @param[in] inputBitwise compared image frame with bitwise_and operation input cv::Mat
-            @param[out] logo camicasa::Logo with image frame found and relevant information
+            @param[out] logos vector of camicasa::Logo with the image frames found and relevant information, in the coordinates 
+            of the screen
             @note See more in camicasa::TVChannel::getFrameStillCount()
         */
-        void findLogo(Mat &inputOriginal, Mat &inputBitwise, Logo &logo);
+        void findLogos(Mat &inputOriginal, Mat &inputBitwise, vector<Logo> &logos);
 
         /**
             @returns returns true if sum of vector camicasa::TVChannel::getFrameStillCount() if different than 0
@@ -143,8 +377,20 @@ namespace camicasa
             @param input image frame input cv::Mat
             @param pattern camicasa::Logo containing the image to search in the input frame
             @returns returns true if the pattern was found
+            @note The edges of the pattern are computed on each call if camicasa::Logo::edges is empty
+        */
+        bool findPatternLogo(Mat &input, const Logo& pattern);
+
+        /**
+            @brief The function camicasa::TVChannel::matchLogos is a method checking which of the logos of the channel are present
+            on the frame, computing the edges of each corner region only once for all the logos inside it
+            @param input image frame input cv::Mat
+            @param[out] matches camicasa::LogoMatch of every logo found, with its score
+            @returns returns true if any logo was found
+            @note A logo is found under the same criteria of camicasa::TVChannel::findPatternLogo, but logos whose edge hash 
+            rules them out are not compared pixel by pixel. See more in camicasa::mayMatchEdges()
         */
-        bool findPatternLogo(Mat &input, Logo& pattern);
+        bool matchLogos(Mat &input, vector<LogoMatch> &matches);
 
         /**
             @brief The function camicasa::TVChannel::updateSegment is a method for updating the segments detected times
@@ -153,6 +399,142 @@ namespace camicasa
             @param pattern new endTimestamp
         */
         void updateSegment(int id, int newStart, int newEnd);
+
+        /**
+            @brief The function camicasa::TVChannel::processFrame runs one step of the logo detection and segment classification 
+            state machine
+            @param frame image frame input cv::Mat
+            @param timestamp position of the frame in milliseconds
+            @param frameNumber position of the frame in number of frames
+            @param black optional result of camicasa::TVChannel::isBlackFrame on the frame if already known (1 or 0), -1 to
+            check it (default is -1)
+            @returns returns a combination of camicasa::AnalysisEvent flags describing what happened on this frame
+            @note A closed segment is the last one in camicasa::TVChannel::getSegments() and a found logo is the last one in 
+            camicasa::TVChannel::getLogos()
+        */
+        int processFrame(Mat &frame, int timestamp, int frameNumber, int black = -1);
+
+        /**
+            @brief The function camicasa::TVChannel::saveCheckpoint writes the state of the analysis (segments, logos with their
+            images, still frame counters with the sampled frames they come from, current segment and flags) to a file, replacing
+            it at once
+            @param path path of the checkpoint file (written as YAML)
+            @param timestamp position in milliseconds of the last frame processed
+            @param frameNumber position in number of frames of the next frame to process
+            @returns returns true if the checkpoint was written
+        */
+        bool saveCheckpoint(string path, int timestamp, int frameNumber);
+
+        /**
+            @brief The function camicasa::TVChannel::loadCheckpoint restores the state of the analysis written by 
+            camicasa::TVChannel::saveCheckpoint
+            @param path path of the checkpoint file
+            @param[out] timestamp position in milliseconds of the last frame processed
+            @param[out] frameNumber position in number of frames of the next frame to process
+            @returns returns true if the checkpoint was read and belongs to an input of the same size and analysis scale
+            @note Must be called before any frame is processed
+        */
+        bool loadCheckpoint(string path, int &timestamp, int &frameNumber);
+
+        /**
+            @brief The function camicasa::TVChannel::finishStream closes the open segment, if any, when the stream ends
+            @param timestamp position of the last frame in milliseconds
+            @returns returns SEGMENT_CLOSED if a segment was closed, NO_EVENT otherwise
+        */
+        int finishStream(int timestamp);
+    };
+
+    /**
+        @brief class camicasa::SegmentExporter writing and trimming segments while the frames are analysed
+        @note Frames are held until they are known to be part of the segment: those of ads until they close (an ad may become
+        a program), and those of programs until a logo shows up after them. Programs are then trimmed to the first and last
+        frames where a logo appears, as the three pass mode does, except when a logo found late also appears before the first
+        frame already matched, which the three pass mode would keep. Held frames past the memory limit are spilled to disk
+        raw (about 6 MB per 1080p frame) until the segment closes
+    */
+    class SegmentExporter {
+    private:
+        /// @brief channel whose segments are exported
+        TVChannel *channel;
+        /// @brief encoder used when no encoder queues are given
+        SegmentEncoder encoder;
+        /// @brief queues of the encoder threads, segments are spread among them by identifier
+        vector<BoundedQueue<EncodeJob>*> encoderQueues;
+        /// @brief maximum number of frames held in memory, the rest are spilled to disk
+        int maximumPendingFrames;
+
+        /// @brief identifier of the segment being written (-1 if none)
+        int segmentId;
+        /// @brief first frame of the open segment, kept for programs where no logo shows up
+        Mat firstFrame;
+        /// @brief frames not known yet to be part of the segment
+        FrameSpool heldFrames;
+        /// @brief the held frames as analysed by the channel, empty when they are the held frames themselves
+        FrameSpool heldAnalysisFrames;
+        /// @brief true if the frames analysed are the frames of the input (no analysis scale), so they are held once
+        bool sharedAnalysis;
+        /// @brief number of held frames already matched against the logos
+        int scannedFrames;
+        /// @brief number of logos of the channel when the held frames were matched
+        int scannedLogos;
+        /// @brief logos found on the last frame added
+        vector<LogoMatch> matches;
+        /// @brief true if a logo was already found in the open segment
+        bool foundNewStart;
+        /// @brief trimmed start of the open segment
+        int newStart;
+        /// @brief trimmed end of the open segment
+        int newEnd;
+
+        /// @brief method for sending a job over the open segment to its encoder
+        void sendJob(EncodeCommand command, Mat frame = Mat());
+
+        /// @brief method for writing the held frames up to the last one where a logo appears, and dropping the ones before the first
+        void writeMatchedFrames();
+
+        /// @brief method for writing every held frame, keeping them all as part of the segment
+        void writeHeldFrames();
+        
+    public:
+        /**
+            @brief constructor of class camicasa::SegmentExporter
+            @param channel camicasa::TVChannel being analysed
+            @param directory directory where the segments are written
+            @param fps number of frames per second of the written videos
+            @param frameSize size of the written frames
+            @param maximumPendingFrames optional maximum number of frames held in memory, the rest are spilled to disk until
+            the segment closes (default is 10 seconds of frames)
+            @param options optional camicasa::VideoOptions of the writer used without encoder threads (default is none)
+        */
+        SegmentExporter(TVChannel *channel, string directory, int fps, Size frameSize, int maximumPendingFrames = -1, const VideoOptions &options = VideoOptions());
+
+        /// @brief destructor of class camicasa::SegmentExporter
+        ~SegmentExporter();
+
+        /**
+            @brief The function camicasa::SegmentExporter::setEncoderQueues makes the exporter hand its frames to encoder threads
+            instead of writing them itself
+            @param queues camicasa::BoundedQueue of each encoder thread, the segment N goes to the queue N % queues.size()
+            @note See more in camicasa::encodeSegments()
+        */
+        void setEncoderQueues(vector<BoundedQueue<EncodeJob>*> queues);
+
+        /**
+            @brief The function camicasa::SegmentExporter::addFrame holds a frame of the open segment, writing the frames known
+            to be part of it, so programs are trimmed to the first and last frames where a logo appears
+            @param frame image frame input cv::Mat
+            @param analysisFrame the same frame as analysed by the channel
+            @param timestamp position of the frame in milliseconds
+        */
+        void addFrame(Mat &frame, Mat &analysisFrame, int timestamp);
+
+        /**
+            @brief The function camicasa::SegmentExporter::closeSegment finishes the last closed segment of the channel, updating
+            its timestamps with the trimmed ones
+            @param frame frame that closed the segment, empty if the stream ended
+            @returns returns the closed camicasa::Segment with the trimmed timestamps
+        */
+        Segment closeSegment(Mat &frame);
     };
 
     /**
@@ -161,9 +543,11 @@ namespace camicasa
         @param frame image frame input cv::Mat
         @param operation defines camicasa::ComparisonOperation to execute (default is CHECK_SMALLER)
         @param threshold optional threshold to compare (default is 1)
+        @param stride optional step between the rows averaged, 1 to average all of them (default is 1)
         @returns returns true if frame presented has average pixels that fall under/above the specified threshold
+        @note 8-bit frames are summed with a vectorized kernel (AVX2, SSE2 or NEON) that stops as soon as the answer is known
     */
-    bool screenThresholdDetection(Mat& frame, ComparisonOperation operation = CHECK_SMALLER, int threshold = 1);
+    bool screenThresholdDetection(Mat& frame, ComparisonOperation operation = CHECK_SMALLER, int threshold = 1, int stride = 1);
 
     /**
         @brief The function camicasa::formatTimestamp is a method converting the duration in milliseconds for human reading
@@ -182,13 +566,107 @@ namespace camicasa
     void convertBinarizedFrame(Mat& frame, Mat& output, BinarizationMode mode = HIGHLIGHT_IN_WHITE);
     
     /**
-        @brief The functions camicasa::cropLogo is a method for finding the logo present and cropping the input frame
+        @brief The functions camicasa::extractLogos is a method for finding the logos present and cropping the input frame, 
+        labelling the connected components of the binarized frame and grouping the ones close to each other
         @param[in] inputOriginal original image frame input cv::Mat
         @param[in] inputBitwise compared image frame with bitwise_and operation input cv::Mat
-        @param[out] output camicasa::Logo containing image frame and other relevant information
+        @param[out] output vector of camicasa::Logo containing image frames and other relevant information, in the coordinates 
+        of the input
+        @param minimumArea optional minimum number of pixels of a logo, smaller groups are noise (default is 64)
+    */
+    void extractLogos(Mat& inputOriginal, Mat& inputBitwise, vector<Logo>& output, int minimumArea = 64);
+
+    /**
+        @brief The functions camicasa::cropLogo is a method for finding the largest logo present and cropping the input frame
+        @param[in] inputOriginal original image frame input cv::Mat
+        @param[in] inputBitwise compared image frame with bitwise_and operation input cv::Mat
+        @param[out] output camicasa::Logo containing image frame and other relevant information, empty if there is none
+        @note See more in camicasa::extractLogos()
     */
     void cropLogo(Mat& inputOriginal, Mat& inputBitwise, Logo& output);
 
+    /**
+        @brief The functions camicasa::isSameLogo is a method for checking if two logos found apart (e.g. by different chunks 
+        or runs) are the same one
+        @param a camicasa::Logo
+        @param b camicasa::Logo
+        @returns returns true if both are in the same corner, overlap in at least half of the smallest one and, when both have
+        their edges, at least half of the edges where they overlap are within a pixel of the edges of the other one
+        @note A new logo shown in the place of another one (e.g. a rebranding) is a different logo
+    */
+    bool isSameLogo(const Logo& a, const Logo& b);
+
+    /**
+        @brief The functions camicasa::computeLogoEdges is a method for finding the edges of a logo image, as compared by
+        camicasa::TVChannel::findPatternLogo
+        @param[in] image logo image input cv::Mat
+        @param[out] edges edges image output cv::Mat
+    */
+    void computeLogoEdges(const Mat& image, Mat& edges);
+
+    /**
+        @brief The functions camicasa::computeEdgeCells is a method for counting the edges of a logo in each cell of an 8x8 grid,
+        the cell of a pixel being (8 * row / rows, 8 * column / columns)
+        @param[in] edges edges image input cv::Mat
+        @param[out] cells number of edges of each cell, row by row
+        @param[out] hash 64-bit hash with the bits of the cells with edges set
+    */
+    void computeEdgeCells(const Mat& edges, vector<int>& cells, uint64_t& hash);
+
+    /**
+        @brief The functions camicasa::hashFrameEdges is a method for finding which cells of an 8x8 grid over a frame region have
+        edges, as camicasa::computeEdgeCells does for logos
+        @param integral integral image (CV_32S) of the edges of the frame, as given by cv::integral
+        @param area region of the frame
+        @returns returns the 64-bit hash with the bits of the cells with edges set
+    */
+    uint64_t hashFrameEdges(const Mat& integral, Rect area);
+
+    /**
+        @brief The functions camicasa::mayMatchEdges is a method for ruling out a logo before comparing its edges pixel by pixel,
+        adding up the edges of the logo in the cells where the frame has edges too
+        @param frameHash hash of the frame region, as given by camicasa::hashFrameEdges
+        @param logo camicasa::Logo with its edge cells computed
+        @returns returns false if the logo cannot reach the score of camicasa::TVChannel::findPatternLogo, true if it may
+        @note The bound is exact, so no logo that would match is ruled out
+    */
+    bool mayMatchEdges(uint64_t frameHash, const Logo& logo);
+
+    /**
+        @brief The functions camicasa::computeFrameEdges is a method for finding the edges of a frame region, to be compared 
+        with the edges of a logo
+        @param[in] input image frame input cv::Mat
+        @param[out] edges edges image output cv::Mat
+    */
+    void computeFrameEdges(const Mat& input, Mat& edges);
+
+    /**
+        @brief The functions camicasa::computeFrameEdges is a method for finding the edges of a frame region, reusing the given 
+        buffers for the intermediate images
+        @param[in] input image frame input cv::Mat
+        @param[out] edges edges image output cv::Mat
+        @param gray buffer for the grayscale image
+        @param blur buffer for the blurred image
+    */
+    void computeFrameEdges(const Mat& input, Mat& edges, Mat& gray, Mat& blur);
+
+    /**
+        @brief The functions camicasa::convertToGray is a method for removing the color of a frame, if it has any
+        @param[in] input image frame input cv::Mat (BGR or grayscale)
+        @param[out] output grayscale image frame output cv::Mat, sharing the input if it is already grayscale
+    */
+    void convertToGray(const Mat& input, Mat& output);
+
+    /**
+        @brief The functions camicasa::compareLogoEdges is a method for scoring how much the edges of a frame region
+        match the edges of a logo
+        @param inputEdges edges of the frame region, the same size as the logo
+        @param patternEdges edges of the logo
+        @returns returns the average of the edges present in both
+        @note The edges are expected to be either 0 or 255, as given by cv::Canny
+    */
+    double compareLogoEdges(const Mat& inputEdges, const Mat& patternEdges);
+
     /**
         @brief The functions camicasa::morphOperation is a method for removing dots and loose pixels in the input frame
         utilizing the cv::morphologyEx function